@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Arduino.h"
+#include "error.h"
+#include "utils.h"
+
+class Stepper;
+
+/**
+ * Hot state of the axes (structure of arrays).
+ *
+ * The step tick goes through all the axes in one pass (Stepper::execAll),
+ * which only touches these arrays: one entry per axis for each field,
+ * so that the data of the pass is packed together instead of being
+ * spread among the pins, bounds and settings of each Stepper.
+ * Steppers are views onto their entry of the block (see stepper.h).
+ */
+namespace axes {
+
+  static const uint8_t MAX_AXES = 8;
+  // entry of the views past MAX_AXES (see attach()), outside of the tick
+  static const uint8_t NO_AXIS = MAX_AXES;
+  static const uint8_t NUM_ENTRIES = MAX_AXES + 1;
+
+  // speeds (fixed-point, see ticker.h)
+  long phase[NUM_ENTRIES];   // fraction of step accumulated (phase accumulator)
+  long v_cur[NUM_ENTRIES];
+  long v_trg[NUM_ENTRIES];
+  long dv[NUM_ENTRIES];      // speed change per tick, only above v_start
+  long da[NUM_ENTRIES];      // change of the speed change per tick (jerk, 0 = constant dv)
+  long a_cur[NUM_ENTRIES];   // speed change of the last tick (S-curves)
+  long v_fade[NUM_ENTRIES];  // speed change until a_cur fades out (S-curves)
+  long v_start[NUM_ENTRIES]; // speed below which a direct speed change is allowed
+  long v_max[NUM_ENTRIES];   // fastest speed of the current gear
+
+  // positions (1/16 microsteps)
+  long steps[NUM_ENTRIES];
+  long minSteps[NUM_ENTRIES];
+  long maxSteps[NUM_ENTRIES];
+  long pulsed[NUM_ENTRIES];  // size of the step of this tick (0 if none)
+  int8_t stepDir[NUM_ENTRIES];
+  uint8_t gear[NUM_ENTRIES]; // log2 of the step size
+  uint8_t topGear[NUM_ENTRIES]; // coarsest gear of the automatic shifts
+
+  // output stage (see pulses.h)
+  uint8_t slot[NUM_ENTRIES];
+  uint8_t mask[NUM_ENTRIES];
+
+  // state
+  bool enabled[NUM_ENTRIES];
+  bool following[NUM_ENTRIES]; // steps are triggered externally
+  bool hardware[NUM_ENTRIES];  // steps are generated by a timer output
+  Stepper *views[NUM_ENTRIES];
+  uint8_t numAxes = 0;
+  uint8_t pulsing = 0; // axes that pulse in this tick (bit i = axis i)
+  uint8_t stopping = 0; // axes that halt at a position by themselves (see Stepper::stopAt)
+  volatile uint8_t changed = 0; // axes with an event for their controller (see Stepper::takeEvent)
+
+  /**
+   * Register a view and return the index of its axis, or NO_AXIS when
+   * they are all taken: the view then has an entry of its own, which
+   * the tick never goes through
+   */
+  uint8_t attach(Stepper *stp) {
+    if(numAxes == MAX_AXES){
+      error = ERR_AXIS_OVERFLOW;
+      return NO_AXIS;
+    }
+    views[numAxes] = stp;
+    return numAxes++;
+  }
+
+  // whether an axis of the step tick moves or may move (see Stepper::isRunning)
+  bool isMoving() {
+    for(uint8_t i = 0; i < numAxes; ++i){
+      if(!hardware[i] && (v_cur[i] || v_trg[i] || following[i]))
+        return true;
+    }
+    return false;
+  }
+
+  /**
+   * Unregister the last view (e.g. temporary steppers of the benchmarks),
+   * with its bits, for the next view on the same entry
+   */
+  void detach(uint8_t i) {
+    if(i + 1 != numAxes)
+      return;
+    CriticalSection cs;
+    --numAxes;
+    views[i] = NULL;
+    uint8_t bit = uint8_t(1 << i);
+    pulsing &= uint8_t(~bit);
+    stopping &= uint8_t(~bit);
+    changed &= uint8_t(~bit);
+  }
+
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "Arduino.h"
+#include "pins.h"
+#include "ticker.h"
+#include "stepper.h"
+#include "locator.h"
+#include "events.h"
+
+/**
+ * On-device benchmarks (command "b ...").
+ *
+ * The step tick is paused while measuring, and timings are reported
+ * in CPU cycles per operation.
+ */
+namespace bench {
+
+  // unused pin (PL1), safe to toggle
+  static const uint8_t BENCH_PIN = 48;
+  static const unsigned int BENCH_RUNS = 1000;
+
+  void report(const char *name, unsigned long us, unsigned long ops){
+    unsigned long cycles = us * (F_CPU / 1000000UL);
+    Serial.print(name); Serial.print(": ");
+    Serial.print(float(cycles) / float(ops), 2);
+    Serial.println(" cycles");
+  }
+
+  /**
+   * Pin writes: digitalWrite() against direct port I/O
+   */
+  void pins() {
+    Pin pin(BENCH_PIN);
+    pin.output();
+    ticker::pause();
+    unsigned long t0 = micros();
+    for(unsigned int i = 0; i < BENCH_RUNS; ++i){
+      digitalWrite(BENCH_PIN, HIGH);
+      digitalWrite(BENCH_PIN, LOW);
+    }
+    unsigned long t1 = micros();
+    for(unsigned int i = 0; i < BENCH_RUNS; ++i){
+      pin.high();
+      pin.low();
+    }
+    unsigned long t2 = micros();
+    ticker::resume();
+    report("digitalWrite", t1 - t0, 2UL * BENCH_RUNS);
+    report("port write  ", t2 - t1, 2UL * BENCH_RUNS);
+  }
+
+  /**
+   * Ramp estimators, from a full-speed reversal (the longest ramp)
+   */
+  void estimators(unsigned long v_start = 1000UL) {
+    Stepper stp(BENCH_PIN, BENCH_PIN, BENCH_PIN, BENCH_PIN, BENCH_PIN, BENCH_PIN, 'b');
+    stp.setStartSpeed(v_start);
+    volatile unsigned long sink = 0UL;
+    ticker::pause();
+    unsigned long t0 = micros();
+    for(unsigned int i = 0; i < BENCH_RUNS; ++i){
+      sink += stp.rampBetweenSpeeds(5000L, -5000L).time;
+    }
+    unsigned long t1 = micros();
+    for(unsigned int i = 0; i < BENCH_RUNS; ++i){
+      sink += stp.rampBetweenSpeeds(5000L, Stepper::IDLE_SPEED).steps;
+    }
+    unsigned long t2 = micros();
+    ticker::resume();
+    Serial.print("v_start="); Serial.println(v_start, DEC);
+    report("timeToSpeed ", t1 - t0, BENCH_RUNS);
+    report("stepsToSpeed", t2 - t1, BENCH_RUNS);
+  }
+
+  /**
+   * XY controller: update() along a line, alone and with a full lookahead,
+   * and the planning of a queued segment (junction speeds and profiles)
+   */
+  void locator() {
+    Stepper x(BENCH_PIN, BENCH_PIN, BENCH_PIN, BENCH_PIN, BENCH_PIN, BENCH_PIN, 'b');
+    Stepper y(BENCH_PIN, BENCH_PIN, BENCH_PIN, BENCH_PIN, BENCH_PIN, BENCH_PIN, 'c');
+    Locator loc(&x, &y);
+    ticker::pause();
+    loc.setTarget(vec2(40000L, 10000L));
+    unsigned long t0 = micros();
+    for(unsigned int i = 0; i < BENCH_RUNS; ++i)
+      loc.update();
+    unsigned long t1 = micros();
+    unsigned long n = 0UL;
+    for(long k = 1L; !loc.isQueueFull(); ++k, ++n)
+      loc.queueTarget(vec2(40000L + 2000L * k, 10000L + (k & 1L ? 500L : 0L)));
+    unsigned long t2 = micros();
+    for(unsigned int i = 0; i < BENCH_RUNS; ++i)
+      loc.update();
+    unsigned long t3 = micros();
+    loc.reset();
+    x.halt();
+    y.halt();
+    ticker::resume();
+    report("line update ", t1 - t0, BENCH_RUNS);
+    report("queue target", t2 - t1, n ? n : 1UL);
+    report("path update ", t3 - t2, BENCH_RUNS);
+  }
+
+  /**
+   * Step queue: planning of the ticks (main loop) against popping their
+   * events (tick), with an extra axis running at 5000 steps/s
+   */
+  void queue() {
+    if(events::isActive()){
+      Serial.println("Step queue in use");
+      return;
+    }
+    Stepper stp(BENCH_PIN, BENCH_PIN, BENCH_PIN, BENCH_PIN, BENCH_PIN, BENCH_PIN, 'b');
+    stp.setStartSpeed(5000UL);
+    stp.moveToSpeed(5000L);
+    ticker::pause();
+    events::setActive(true);
+    unsigned long planUs = 0UL, popUs = 0UL, ticks = 0UL;
+    while(ticks < BENCH_RUNS){
+      unsigned long t0 = micros();
+      unsigned int lead;
+      do {
+        lead = events::lead();
+        events::fill();
+      } while(events::lead() != lead);
+      unsigned long t1 = micros();
+      for(unsigned int i = 0; i < lead; ++i)
+        events::pop();
+      unsigned long t2 = micros();
+      planUs += t1 - t0;
+      popUs += t2 - t1;
+      ticks += lead;
+      if(!lead) break;
+    }
+    events::clear();
+    events::setActive(false);
+    stp.halt();
+    ticker::resume();
+    report("plan tick", planUs, ticks);
+    report("pop tick ", popUs, ticks);
+    Serial.print("max rates: ");
+    Serial.print(planUs ? float(ticks) * 1e6f / float(planUs) : 0.0f, 0);
+    Serial.print(" planned and ");
+    Serial.print(popUs ? float(ticks) * 1e6f / float(popUs) : 0.0f, 0);
+    Serial.println(" popped ticks/s");
+  }
+
+}
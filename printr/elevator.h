@@ -3,25 +3,37 @@
 #include "Arduino.h"
 #include "utils.h"
 #include "stepper.h"
+#include "locator.h"
 
 class Elevator {
 public:
 
 	typedef void (*Callback)(int state);
 
-	explicit Elevator(Stepper *z) : stpZ(z) {
+	explicit Elevator(Stepper *z) : stpZ(z), carrier(NULL), rider(0) {
 		reset();
 	}
 	
 	void update(){
     if(!enabled) return;
+    // carried by the lines of a Locator (see ride()), then back to
+    // the target by itself if they did not get there (e.g. reset lines)
+    if(riding){
+      if(carrier->isCarrying(rider))
+        return;
+      riding = false;
+      dirty = true;
+    }
+    // events since the last update (see Stepper::takeEvent)
+    bool changed = stpZ->takeEvent() || dirty;
+    dirty = false;
 		// were we moving?
 		if(!hasTarget()){
       // Serial.println("No Z target");
       if(!stpZ->lowMicrostep()){
         stpZ->microstep(Stepper::MS_SLOW);
       }
-			stpZ->moveToFreq(Stepper::IDLE_FREQ);
+			stpZ->moveToSpeed(Stepper::IDLE_SPEED);
 			return;
 		}
 		// are we done moving?
@@ -30,54 +42,106 @@ public:
       if(!stpZ->lowMicrostep()){
         stpZ->microstep(Stepper::MS_SLOW);
       }
-			stpZ->moveToFreq(Stepper::IDLE_FREQ);
+			stpZ->moveToSpeed(Stepper::IDLE_SPEED);
 			if(callback){
 				callback(state);
 			}
 			lastTarget = currTarget;
-		} else {
-			// move at the best frequency (directly)
+		} else if(stpZ->usesTimer()){
+      // the step timer stops on the target by itself,
+      // brake before it so that it ends at the start speed
       long dz = realDelta();
-			stpZ->moveToFreq(bestFreq(dz));
-			stpZ->setSafeFreq(f_best);
-			stpZ->setDeltaFreq(df_max);
-     
-      // acceleration with ms
-      if(std::abs(stpZ->currentFreq()) == 1L){
-        dz = std::abs(dz);
-        if(dz > 4000L){
-          stpZ->microstep(Stepper::MS_1_2);
-        } else if(dz >= 1000L){
-          stpZ->microstep(Stepper::MS_1_4);
-        } else if(!stpZ->lowMicrostep()){
-          stpZ->microstep(Stepper::MS_SLOW);
-        }
+      long left = stpZ->timerLeft();
+      bool moved = left && dz != stpZ->direction() * long(left); // new target
+      if(!left || (moved && !stpZ->currentSpeed())){
+        stpZ->moveTimerBy(dz);
+        moved = false;
       }
-      // Serial.print("Freq: "); Serial.println(stpZ->targetFreq());
+      long v = bestSpeed(dz);
+      long v_end = sign(dz) * stpZ->startSpeed();
+      // the stop distance only changes along the ramps and with new targets
+      if(changed || moved || stpZ->currentSpeed() != stpZ->targetSpeed())
+        stop = std::abs(stpZ->stepsToSpeed(v_end) - stpZ->value());
+      if(moved)
+        v = Stepper::IDLE_SPEED; // stop before moving again
+      else if(stop >= long(stpZ->timerLeft()))
+        v = v_end;
+			stpZ->setAcceleration(accel);
+			stpZ->setJerk(jerk);
+      if(stpZ->targetSpeed() != v)
+			  stpZ->moveToSpeed(v);
+		} else if(!stpZ->stopsAt(currTarget)){
+			// move at the best speed, the tick brakes and halts
+			// on the target by itself (see Stepper::stopAt)
+      long dz = realDelta();
+			stpZ->setAcceleration(accel);
+			stpZ->setJerk(jerk);
+			stpZ->moveToSpeed(bestSpeed(dz));
+      stpZ->stopAt(currTarget);
 		}
 	}
 
-  long bestFreq(long delta) const {
-    return sign(delta) * f_best;
+  long bestSpeed(long delta) const {
+    return sign(delta) * long(feed ? std::min(feed, v_best) : v_best);
   }
 	
 	// --- setters ---------------------------------------------------------------
-	void setTarget(long z){
+	// target, with the speed of its move (e.g. gcode feedrate, 0 for the best speed)
+	void setTarget(long z, unsigned long f = 0UL){
+		// soft limits, checked once here (see Stepper::guardBounds)
+		if(!isValidTarget(z)){
+			error = ERR_OUT_OF_BOUNDS;
+			return;
+		}
 		lastTarget = currTarget;
 		currTarget = z;
+		feed = f;
+		riding = false;
+		dirty = true;
     if(debugMode){
       Serial.print("New targets: ");
       Serial.print(lastTarget); Serial.print(" -> "); Serial.println(currTarget);
       Serial.print("Current: "); Serial.println(stpZ->value());
     }
 	}
-	void setBestFreq(unsigned long f){
-		if(f)
-			f_best = f;
+	/**
+	 * Target reached by riding the lines of the carrier, which move z along
+	 * with them (see Locator::setRider): the elevator waits for them instead
+	 */
+	void ride(long z){
+		if(!carrier){
+			setTarget(z);
+			return;
+		}
+		if(!isValidTarget(z)){
+			error = ERR_OUT_OF_BOUNDS;
+			return;
+		}
+		lastTarget = currTarget;
+		currTarget = z;
+		feed = 0UL;
+		riding = true;
+	}
+	void setCarrier(const Locator *loc, uint8_t i){
+		carrier = loc;
+		rider = i;
+	}
+	// speed (steps/s)
+	void setBestSpeed(unsigned long v){
+		if(v)
+			v_best = v;
+		dirty = true;
 	}
-	void setMaxDeltaFreq(unsigned long df){
-		if(df)
-			df_max = df;
+	// acceleration (steps/s²)
+	void setAcceleration(unsigned long a){
+		if(a)
+			accel = a;
+		dirty = true;
+	}
+	// jerk (steps/s³), 0 for constant accelerations
+	void setJerk(unsigned long j){
+		jerk = j;
+		dirty = true;
 	}
 	void setCallback(Callback cb){
 		callback = cb;
@@ -86,22 +150,31 @@ public:
 		state = s0;
 	}
 	void reset(){
-		f_best = 1L;
-		df_max = 2L;
+		v_best = 40000UL; // with gears up to 1/2 (see speeds.h)
+		accel = Stepper::DEFAULT_ACCEL;
+		jerk = 0UL;
 		lastTarget = currTarget = stpZ->value();
+		feed = 0UL;
+		riding = false;
 		callback = NULL;
 		state = 0;
     enabled = true;
+    dirty = true;
+    stop = 0L;
 	}
   void resetZ(long z){
     stpZ->resetPosition(z);
     lastTarget = currTarget = z;
+    riding = false;
+    dirty = true;
   }
   void toggle(){
     enabled = !enabled;
+    dirty = true;
   }
   void enable(){
     enabled = true;
+    dirty = true;
   }
   void disable(){
     enabled = false;
@@ -114,6 +187,9 @@ public:
   bool isEnabled() const {
     return enabled;
   }
+  bool isRiding() const {
+    return riding;
+  }
   long realDelta() const {
     return currTarget - stpZ->value();
   }
@@ -125,19 +201,23 @@ public:
   bool hasTarget() const {
     return lastTarget != currTarget || !hasReachedTarget();
   }
+  bool isValidTarget(long z) const {
+    return stpZ->isWithinBounds(z);
+  }
   bool hasReachedTarget() const {
-    long currDelta = stpZ->value() - currTarget;
-    long fullDelta = lastTarget - currTarget;
-    return currDelta * fullDelta < 0L || std::abs(currDelta) <= stpZ->stepSize();
+    // exact end of moveTimerBy() or stopAt()
+    return stpZ->value() == currTarget;
   }
 
 public:
   void debug() {
     Serial.println("debug(h):");
-    Serial.print("f_best "); Serial.println(f_best, DEC);
-    Serial.print("df_max "); Serial.println(df_max, DEC);
+    Serial.print("v_best "); Serial.println(v_best, DEC);
+    Serial.print("feed   "); Serial.println(feed, DEC);
+    Serial.print("accel  "); Serial.println(accel, DEC);
+    Serial.print("jerk   "); Serial.println(jerk, DEC);
     Serial.print("lastTg "); Serial.println(lastTarget, DEC);
-    Serial.print("currTg "); Serial.println(currTarget, DEC);
+    Serial.print("currTg "); Serial.print(currTarget, DEC); Serial.println(riding ? " (riding)" : "");
   }
 
   void setDebugMode(int m){
@@ -146,11 +226,16 @@ public:
 
 private:
 	Stepper *stpZ;
-	unsigned long f_best, df_max;
+	const Locator *carrier; // with z as rider (see ride())
+	uint8_t rider;
+	unsigned long v_best, accel; // steps/s, steps/s²
+	unsigned long jerk;          // steps/s³
+	unsigned long feed;          // speed of the current move (steps/s, 0 = v_best)
 	
 	// xy target data
 	long lastTarget;
 	long currTarget;
+	long stop; // stop distance with the step timer
 	
 	// callback
 	Callback callback;
@@ -158,6 +243,8 @@ private:
 
   // state
   bool enabled;
+  bool dirty; // to recompute in update()
+  bool riding; // moved by a Locator (see ride())
   int debugMode;
 };
 
@@ -20,7 +20,15 @@ enum ErrorType {
   ERR_FILE_PROC_STATE  = 13,
   ERR_BOUNDARY_TYPE    = 14,
   ERR_MISSING_RANGE    = 15,
-  ERR_INVALID_DELTA_F  = 16
+  ERR_INVALID_ACCEL    = 16,
+  ERR_NO_TIMER         = 17,
+  ERR_MIXED_TIMERS     = 18,
+  ERR_EVENT_OVERFLOW   = 19,
+  ERR_OUT_OF_BOUNDS    = 20,
+  ERR_SEGMENT_OVERFLOW = 21,
+  ERR_INVALID_ARC      = 22,
+  ERR_AXIS_OVERFLOW    = 23,
+  ERR_INVALID_PIN      = 24
 };
 
 int error;
@@ -74,8 +82,32 @@ void logError() {
     case ERR_MISSING_RANGE:
       Serial.println("Cannot calibrate without stepper range values.");
       break;
-    case ERR_INVALID_DELTA_F:
-      Serial.println("Cannot have a null delta frequency!");
+    case ERR_INVALID_ACCEL:
+      Serial.println("Cannot have a null acceleration!");
+      break;
+    case ERR_NO_TIMER:
+      Serial.println("Axis without step timer!");
+      break;
+    case ERR_MIXED_TIMERS:
+      Serial.println("Lines need both or no step timers!");
+      break;
+    case ERR_EVENT_OVERFLOW:
+      Serial.println("Too many pin writes in the step queue!");
+      break;
+    case ERR_OUT_OF_BOUNDS:
+      Serial.println("Target out of bounds!");
+      break;
+    case ERR_SEGMENT_OVERFLOW:
+      Serial.println("Too many segments in the lookahead!");
+      break;
+    case ERR_INVALID_ARC:
+      Serial.println("Invalid arc!");
+      break;
+    case ERR_AXIS_OVERFLOW:
+      Serial.println("Too many axes!");
+      break;
+    case ERR_INVALID_PIN:
+      Serial.println("Invalid pin!");
       break;
     case -1:
       return;
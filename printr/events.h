@@ -0,0 +1,253 @@
+#pragma once
+
+#include "Arduino.h"
+#include "utils.h"
+#include "error.h"
+#include "pins.h"
+#include "pulses.h"
+#include "axes.h"
+#include "ticker.h"
+
+/**
+ * Step event queue (queued mode, "s q 1").
+ *
+ * The step tick is planned ahead of time by the main loop (fill()),
+ * and recorded as compact events: the axes that pulse, the pin writes
+ * that go with them (directions, microstep modes, enable) and the number
+ * of ticks since the previous event. The tick interrupt only pops the
+ * events and writes the ports (pop()), so that it does not depend on the
+ * motion planning anymore, and the hiccups of the main loop (SD card,
+ * parsing) are absorbed by the queue.
+ *
+ * Positions and speeds of the steppers are those of the planner,
+ * ahead of the motors by the ticks in the queue (see lead()), and by
+ * the planned steps of each axis (see pending()).
+ */
+namespace events {
+
+  typedef void (*Planner)(); // one tick of the step generation
+
+  static const uint8_t DEPTH = 128;      // events (power of two)
+  static const uint8_t MAX_WRITES = 64;  // deferred pin writes (power of two)
+  static const uint8_t TICK_WRITES = 24; // worst case of a planned tick
+  static const unsigned int MAX_LEAD = 250; // planned ticks ahead of the motors
+  static const uint8_t FILL_TICKS = 8;   // planned ticks per fill()
+  static const unsigned int MAX_MOVES = 256; // planned pulses (uint8_t indices)
+
+  struct Event {
+    uint8_t axes;   // pulses (bit i = axis i, see axes.h)
+    uint8_t writes; // deferred pin writes, before the pulses
+    uint8_t wait;   // ticks since the previous event
+    uint8_t moves;  // number of pulses
+  };
+  struct Write {
+    const Pin *pin;
+    uint8_t level;
+  };
+
+  // queue (single producer = main loop, single consumer = tick)
+  Event queue[DEPTH];
+  volatile uint8_t head = 0, tail = 0;
+  Write writes[MAX_WRITES];
+  volatile uint8_t whead = 0, wtail = 0;
+  int8_t moves[MAX_MOVES]; // signed size of each planned pulse, by event and axis
+  volatile uint8_t mhead = 0, mtail = 0;
+  volatile unsigned int planned = 0; // ticks in the queue
+
+  // planner state
+  Planner planner = NULL;
+  bool active = false;
+  uint8_t pendingWrites = 0; // written since the last event
+  uint8_t pendingWait = 0;   // ticks since the last event
+
+  // statistics
+  volatile bool moving = false;          // the planner has more to do
+  volatile unsigned long underruns = 0UL; // ticks without planned event while moving
+  uint8_t maxFill = 0;
+
+  // --- queue -----------------------------------------------------------------
+  uint8_t size() {
+    return uint8_t(tail - head) & (DEPTH - 1);
+  }
+  uint8_t numWrites() {
+    return uint8_t(wtail - whead) & (MAX_WRITES - 1);
+  }
+  uint8_t numMoves() {
+    return uint8_t(mtail - mhead);
+  }
+  bool isEmpty() {
+    return head == tail;
+  }
+  bool isFull() {
+    return size() == DEPTH - 1;
+  }
+  // planned ticks ahead of the motors
+  unsigned int lead() {
+    CriticalSection cs;
+    return planned;
+  }
+
+  void push(uint8_t axes) {
+    Event &e = queue[tail];
+    e.axes = axes;
+    e.writes = pendingWrites;
+    e.wait = pendingWait + 1;
+    e.moves = 0;
+    // signed sizes of the pulses, to rewind the planner (see clear())
+    uint8_t a = axes;
+    for(uint8_t i = 0; a; ++i, a >>= 1){
+      if(a & 1){
+        moves[mtail++] = int8_t(axes::stepDir[i] < 0 ? -axes::pulsed[i] : axes::pulsed[i]);
+        ++e.moves;
+      }
+    }
+    {
+      CriticalSection cs;
+      planned += e.wait;
+    }
+    tail = (tail + 1) & (DEPTH - 1);
+    pendingWrites = pendingWait = 0;
+    uint8_t n = size();
+    if(n > maxFill) maxFill = n;
+  }
+
+  /**
+   * Write a pin at the current time of the planner (after the queued pulses)
+   */
+  void defer(const Pin &pin, int level) {
+    if(numWrites() == MAX_WRITES - 1){
+      error = ERR_EVENT_OVERFLOW;
+      pin.write(level);
+      return;
+    }
+    writes[wtail].pin = &pin;
+    writes[wtail].level = level == LOW ? LOW : HIGH;
+    wtail = (wtail + 1) & (MAX_WRITES - 1);
+    ++pendingWrites;
+  }
+
+  // --- tick (interrupt) ------------------------------------------------------
+  /**
+   * Rising phase of the tick in queued mode
+   */
+  void pop() {
+    if(head == tail){
+      if(moving) ++underruns;
+      return;
+    }
+    Event &e = queue[head];
+    --planned;
+    if(--e.wait) return;
+    for(uint8_t i = 0; i < e.writes; ++i){
+      writes[whead].pin->write(writes[whead].level);
+      whead = (whead + 1) & (MAX_WRITES - 1);
+    }
+    pulses::markAxes(e.axes);
+    pulses::rise();
+    mhead += e.moves;
+    head = (head + 1) & (DEPTH - 1);
+  }
+
+  // --- planning (main loop) --------------------------------------------------
+  /**
+   * Plan the next ticks, up to the lead limit
+   */
+  void fill() {
+    if(!active) return;
+    moving = axes::isMoving();
+    for(uint8_t n = 0; n < FILL_TICKS && moving; ++n){
+      if(isFull() || lead() + pendingWait >= MAX_LEAD
+      || numWrites() + TICK_WRITES >= MAX_WRITES
+      || numMoves() + axes::numAxes >= MAX_MOVES)
+        return;
+      planner();
+      if(axes::pulsing || pendingWrites || pendingWait == 0xFE)
+        push(axes::pulsing);
+      else
+        ++pendingWait;
+      moving = axes::isMoving();
+    }
+    if(!moving){
+      // nothing planned anymore, the pending writes go out on their own
+      pendingWait = 0;
+      if(pendingWrites && !isFull())
+        push(0);
+    }
+  }
+
+  /**
+   * Drop the planned events (reset, errors, endstops): the positions of the
+   * planner go back to those of the motors, and the pin writes go out now,
+   * so that the pins match the directions and gears of the planner
+   */
+  void clear() {
+    CriticalSection cs;
+    for(uint8_t e = head; e != tail; e = (e + 1) & (DEPTH - 1)){
+      uint8_t a = queue[e].axes;
+      for(uint8_t i = 0; a; ++i, a >>= 1){
+        if(a & 1)
+          axes::steps[i] -= moves[mhead++];
+      }
+    }
+    while(whead != wtail){
+      writes[whead].pin->write(writes[whead].level);
+      whead = (whead + 1) & (MAX_WRITES - 1);
+    }
+    head = tail;
+    planned = 0;
+    pendingWrites = pendingWait = 0;
+    moving = false;
+  }
+
+  // --- setters ---------------------------------------------------------------
+  void begin(Planner p) {
+    planner = p;
+  }
+  void setActive(bool on) {
+    if(on == active) return;
+    if(!on){
+      // let the motors catch up with the planner
+      moving = false;
+      if(pendingWrites)
+        push(0);
+      while(!isEmpty())
+        delayMicroseconds(ticker::tickPeriod());
+    }
+    active = on;
+    underruns = 0UL;
+    maxFill = 0;
+  }
+
+  // --- getters ---------------------------------------------------------------
+  bool isActive() {
+    return active;
+  }
+  // distance of the planned pulses of an axis, ahead of its motor (1/16 microsteps)
+  long pending(uint8_t ax) {
+    CriticalSection cs;
+    long d = 0L;
+    uint8_t m = mhead;
+    for(uint8_t e = head; e != tail; e = (e + 1) & (DEPTH - 1)){
+      uint8_t a = queue[e].axes;
+      for(uint8_t i = 0; a; ++i, a >>= 1){
+        if(a & 1){
+          if(i == ax) d += moves[m];
+          ++m;
+        }
+      }
+    }
+    return d;
+  }
+
+  void debug() {
+    Serial.println("debug(q):");
+    Serial.print("active "); Serial.println(active ? 1 : 0, DEC);
+    Serial.print("depth  "); Serial.println(DEPTH - 1, DEC);
+    Serial.print("fill   "); Serial.print(size(), DEC);
+      Serial.print(", max "); Serial.println(maxFill, DEC);
+    Serial.print("writes "); Serial.println(numWrites(), DEC);
+    Serial.print("lead   "); Serial.print(lead(), DEC); Serial.println(" ticks");
+    Serial.print("under  "); Serial.println(underruns, DEC);
+  }
+
+}
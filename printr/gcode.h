@@ -62,20 +62,43 @@ namespace gcode {
   };
 
   bool debug = false;
-  long Espeed = 10L;
+  long Espeed = 500L; // steps/s, without xy move
+  long Eflow = 25L;   // steps per 1000 steps of xy path (Espeed at the default xy speed)
+  long arcTolerance = 2L; // distance from the lines of an arc to its circle (steps)
+
+  // axes carried along the xy lines (see Locator::setRider)
+  static const uint8_t Z_RIDER = 0;
+  static const uint8_t E_RIDER = 1;
   
   class CommandReader {
   public:
 
-    CommandReader() : input(NULL), locXY(NULL), locZ(NULL), stpE(NULL) {}
+    CommandReader() : input(NULL), locXY(NULL), locZ(NULL), stpE(NULL), pending(false) {
+      arc.left = 0;
+    }
     CommandReader(Stream &s, Locator *xy, Elevator *z, Stepper *e, float f = 1.0) : input(&s), line(s), locXY(xy), locZ(z), stpE(e), scale(f), metric(true) {
       X = Y = Z = A = E = F = P = S = 0;  
+      I = J = R = 0;
+      hasI = hasJ = hasR = false;
+      arc.left = 0;
+      lastE = flow = 0L;
+      Ecarry = 0.0f;
+      feed = 0UL;
       absolute = true;
+      pending = false;
     }
     
     bool available(){
       return input && input->available();
     }
+    // whether a move command waits for the queued ones
+    bool isWaiting() const {
+      return pending && (locXY->hasTarget() || locZ->hasTarget());
+    }
+    // whether a move command is left to execute (e.g. the last line of a file)
+    bool isPending() const {
+      return pending || arc.left;
+    }
     
     /**
      * Simulate the full gcode to provide a description of it
@@ -99,6 +122,19 @@ namespace gcode {
      * @param bool simul whether to run the commands or just simulate them
      */
     void next(bool simul = false){
+      if(arc.left){
+        // lines of the current arc first, the lookahead is full again
+        feedArc();
+        return;
+      }
+      if(pending){
+        // move command waiting for the queued ones (see isSynchronized())
+        if(isWaiting())
+          return;
+        pending = false;
+        if(execCommand(Field('G', G), simul))
+          return;
+      }
       if(debug) Serial.println("{");
       bool idle = true;
       while(input->available() && idle){
@@ -126,7 +162,10 @@ namespace gcode {
             case 'Z': hasZ = true; Z = convertToUnit(field.value); if(!command) command = Field('G', G); break;
             case 'A': hasA = true; A = convertToUnit(field.value); if(!command) command = Field('G', G); break;
             case 'E': hasE = true; E = convertToUnit(field.value); if(!command) command = Field('G', G); break;
-            case 'F': hasF = true; F = convertToUnit(field.value); if(!command) command = Field('G', G); break;
+            case 'F': hasF = true; F = convertToSpeed(field.value); if(!command) command = Field('G', G); break;
+            case 'I': hasI = true; I = convertToUnit(field.value); if(!command) command = Field('G', G); break;
+            case 'J': hasJ = true; J = convertToUnit(field.value); if(!command) command = Field('G', G); break;
+            case 'R': hasR = true; R = convertToUnit(field.value); if(!command) command = Field('G', G); break;
             
             // move command
             case 'G':
@@ -159,9 +198,13 @@ namespace gcode {
     }
 
     long convertToUnit(float value) const {
+      return convertToSpeed(value * scale);
+    }
+    // speeds are not scaled with the positions (steps per time unit)
+    long convertToSpeed(float value) const {
       float factor = metric ? 1.0 : 25.4;
       float mmToSteps = 5000.0 / 56.0;
-      return (long)std::round(factor * value * scale * mmToSteps); 
+      return (long)std::round(factor * value * mmToSteps); 
     }
 
   protected:
@@ -173,12 +216,12 @@ namespace gcode {
       bool res = false;
       switch(command.code){
         case 'G':
+          G = id; // store this command (the implicit one of the next lines)
           if(simulation){
             simulateMoveCommand(id); // no interruption since we don't have to wait for the real movement
           } else {
             res = execMoveCommand(id);
           }
-          G = id; // store this command
           break;
         case 'M':
           res = execModalCommand(id);
@@ -187,7 +230,10 @@ namespace gcode {
           error = ERR_INVALID_G_CODE;
           return false;
       }
+      if(pending)
+        return res; // parameters kept for the next try
       hasX = hasY = hasZ = hasA = hasE = hasF = false;
+      hasI = hasJ = hasR = false;
       P = S = 0L;
       return res;
     }
@@ -197,64 +243,82 @@ namespace gcode {
         case 0:
         // --- linear movement
         case 1: {
-          // extrusion
-          if(hasE){
-            lastE = E; // relative extrusion level
-            if(E == 0L){
-              stpE->moveToFreq(0L);
-            } else if(E > 0){
-              stpE->moveToFreq(Espeed);
-            } else {
-              stpE->moveToFreq(-Espeed);
-            }
-          } else if(hasA){
-            long dE = A - lastE; // relative extrusion level
-            lastE = A; // absolute extrusion level
-            if(dE == 0L){
-              stpE->moveToFreq(0L);
-            } else if(dE > 0){
-              stpE->moveToFreq(Espeed);
-            } else {
-              stpE->moveToFreq(-Espeed);
-            }
-          } else if(A){
-            // stop extrusion?
-            stpE->moveToFreq(Stepper::IDLE_FREQ);
+          // soft limits, before any axis moves
+          if(!isValidMove()){
+            error = ERR_OUT_OF_BOUNDS;
+            return false;
           }
-
-          // speed
-          if(hasF){
-            // TODO change XYZ speed accordingly
+          // extrusion changes and z moves on their own wait for the queued xy segments
+          if(!isSynchronized()){
+            pending = true;
+            return true; // same command again, see next()
           }
+          extrude();
+          if(hasF)
+            feed = feedrate();
+          // rapids at the best speed of the planner, the feedrate is for the next G1
+          unsigned long v = id == 0 ? 0UL : feed;
           
           // movement
-          if(hasZ){
-            long curZ = locZ->target();
-            if(absolute && curZ != Z){
-              locZ->setTarget(Z);
-            } else if(!absolute && Z){
-              locZ->setTarget(curZ + Z);
-            } else {
-              hasZ = false; // invalidate
-            }
-          }
+          long dz = moveZ();
+          if(!dz)
+            hasZ = false; // invalidate
+          if(!movesXY())
+            hasX = hasY = false; // invalidate
           if(hasX || hasY){
             vec2 xy = locXY->target();
-            if(absolute && ((hasX && xy.x != X) || (hasY && xy.y != Y))){
-              locXY->setTarget(vec2(X, Y));
-            } else if(!absolute && ((hasX && X) || (hasY && Y))){
-              locXY->setTarget(xy + vec2(hasX ? X : 0, hasY ? Y : 0));
+            vec2 trg = absolute ? vec2(X, Y) : xy + vec2(hasX ? X : 0, hasY ? Y : 0);
+            // one line for all the axes, z and e ride along
+            long ride[Locator::MAX_RIDERS] = { 0L };
+            if(extrudesAlong())
+              ride[E_RIDER] = extrusionAlong(trg - xy);
+            if(hasZ && locXY->canRide(Z_RIDER)){
+              ride[Z_RIDER] = dz;
+              locXY->queueTarget(trg, ride, feedAlong(v, trg - xy, dz));
+              locZ->ride(locZ->target() + dz);
+              hasZ = false;
             } else {
-              hasX = hasY = false; // invalidate
+              locXY->queueTarget(trg, ride, v);
             }
           }
+          if(hasZ){
+            // on its own, the next moves wait for it (see isSynchronized())
+            locZ->setTarget(locZ->target() + dz, v);
+          }
         } return hasX || hasY;
 
-        // --- rotation (NOT SUPPORTED)
+        // --- circular movement (2 = clockwise, 3 = counterclockwise)
         case 2:
         case 3: {
-          
-        } break;
+          if(!isValidMove()){
+            error = ERR_OUT_OF_BOUNDS;
+            return false;
+          }
+          if(!isSynchronized()){
+            pending = true;
+            return true; // same command again, see next()
+          }
+          if(!startArc(locXY->target(), id == 2))
+            return false;
+          // soft limits of the whole circle part
+          if(!locXY->isValidTarget(arc.min) || !locXY->isValidTarget(arc.max)){
+            arc.left = 0;
+            error = ERR_OUT_OF_BOUNDS;
+            return false;
+          }
+          extrude();
+          if(hasF)
+            feed = feedrate();
+
+          // z rides along the lines of the arc (helix), or moves on its own
+          long dz = moveZ();
+          arc.dz = arc.z = 0L;
+          if(dz && locXY->canRide(Z_RIDER))
+            arc.dz = dz;
+          else if(dz)
+            locZ->setTarget(locZ->target() + dz, feed);
+          feedArc();
+        } return true;
 
         // --- dwelling
         case 4: {
@@ -312,6 +376,219 @@ namespace gcode {
       }
       return false;
     }
+    // extrusion of a move, along its xy lines or at its own speed
+    void extrude(){
+      if(!hasE && !hasA && !A)
+        return;
+      flow = extrusionSpeed();
+      if(!extrudesAlong())
+        stpE->moveToSpeed(flow);
+      if(hasE)
+        lastE = E; // relative extrusion level
+      else if(hasA)
+        lastE = A; // absolute extrusion level
+    }
+    // path speed of the F field, in distance per minute (steps/s, 0 for the best speed)
+    unsigned long feedrate() const {
+      return F > 0L ? std::max(1UL, (unsigned long)F / 60UL) : 0UL;
+    }
+    // speed of the xy line of a move, the feedrate v being that of its xyz path
+    unsigned long feedAlong(unsigned long v, const vec2 &delta, long dz) const {
+      if(!v || !dz)
+        return v;
+      float dx = float(delta.x), dy = float(delta.y), l = sqrt(dx * dx + dy * dy);
+      return std::max(1UL, (unsigned long)(float(v) * l / sqrt(l * l + float(dz) * float(dz))));
+    }
+    // extrusion speed of a linear move (steps/s)
+    long extrusionSpeed() const {
+      long dE;
+      if(hasE)
+        dE = E; // relative extrusion level
+      else if(hasA)
+        dE = A - lastE; // absolute extrusion level
+      else if(A)
+        return Stepper::IDLE_SPEED; // stop extrusion?
+      else
+        return flow;
+      if(dE == 0L)
+        return 0L;
+      return dE > 0 ? Espeed : -Espeed;
+    }
+    // whether the extrusion of a linear move rides along its xy line,
+    // with the path speed (otherwise it runs at its own speed)
+    bool extrudesAlong() const {
+      return movesXY() && locXY->canRide(E_RIDER);
+    }
+    // extrusion distance along an xy line, at the flow of the current level
+    long extrusionAlong(const vec2 &delta){
+      if(!flow){
+        Ecarry = 0.0f;
+        return 0L;
+      }
+      float dx = float(delta.x), dy = float(delta.y);
+      float e = Ecarry + sqrt(dx * dx + dy * dy) * float(Eflow) * 1e-3f;
+      long dE = long(e + 0.5f); // the rest goes on with the next lines
+      Ecarry = e - float(dE);
+      return flow > 0L ? dE : -dE;
+    }
+    // z distance of a linear move
+    long moveZ() const {
+      if(!hasZ)
+        return 0L;
+      return absolute ? Z - locZ->target() : Z;
+    }
+    // whether a linear move changes the xy target
+    bool movesXY() const {
+      if(G == 2 || G == 3)
+        return true; // arcs, including full circles
+      vec2 xy = locXY->target();
+      if(absolute)
+        return (hasX && xy.x != X) || (hasY && xy.y != Y);
+      return (hasX && X) || (hasY && Y);
+    }
+    // whether a linear move can start while the previous ones are queued:
+    // z and extrusion are part of the xy segments when they ride along them
+    // (see Locator::setRider), otherwise they move on their own
+    bool isSynchronized() const {
+      if(locZ->hasTarget() && !locZ->isRiding())
+        return false;
+      if(!locXY->hasTarget())
+        return true;
+      if(moveZ() && !(movesXY() && locXY->canRide(Z_RIDER)))
+        return false;
+      return extrudesAlong() || extrusionSpeed() == stpE->targetSpeed();
+    }
+    // whether the targets of a linear move are within the bounds
+    bool isValidMove() const {
+      if(hasZ && !locZ->isValidTarget(absolute ? Z : locZ->target() + Z))
+        return false;
+      if(hasX || hasY){
+        vec2 xy = locXY->target();
+        vec2 trg = absolute ? vec2(X, Y) : xy + vec2(hasX ? X : 0, hasY ? Y : 0);
+        if(!locXY->isValidTarget(trg))
+          return false;
+      }
+      return true;
+    }
+    /**
+     * Cut a G2/G3 arc from a point into lines, with the center given by
+     * its offset from that point (I, J) or by the radius (R, negative
+     * for the arc longer than half a circle). The same end as the start
+     * makes a full circle (offset form only).
+     *
+     * The lines have the same angle, small enough that their chords stay
+     * within arcTolerance of the circle: 2 acos(1 - tolerance / radius).
+     * Their points turn around the center by the same rotation in fixed
+     * point (see nextArcPoint()), and the last one is the end itself.
+     */
+    bool startArc(const vec2 &from, bool clockwise){
+      arc.left = 0;
+      vec2 to = absolute ? vec2(X, Y) : from + vec2(hasX ? X : 0, hasY ? Y : 0);
+      float dx = float(to.x - from.x), dy = float(to.y - from.y);
+      float cx, cy;
+      if(hasR){
+        // center on the bisector of the chord
+        float d = sqrt(dx * dx + dy * dy);
+        float r = float(R);
+        // a half circle may be a bit short of its radius with rounded end points
+        if(d == 0.0f || d > 2.0f * fabs(r) + 1.0f){
+          error = ERR_INVALID_ARC;
+          return false;
+        }
+        float h = std::max(0.0f, r * r - 0.25f * d * d);
+        h = sqrt(h) / d;
+        if(clockwise != (R < 0L))
+          h = -h;
+        cx = float(from.x) + 0.5f * dx - h * dy;
+        cy = float(from.y) + 0.5f * dy + h * dx;
+      } else if(hasI || hasJ){
+        cx = float(from.x + I);
+        cy = float(from.y + J);
+      } else {
+        error = ERR_INVALID_ARC;
+        return false;
+      }
+      float x0 = float(from.x) - cx, y0 = float(from.y) - cy;
+      float r = sqrt(x0 * x0 + y0 * y0);
+      if(r < 1.0f){
+        error = ERR_INVALID_ARC;
+        return false;
+      }
+      float a0 = atan2(y0, x0);
+      float sweep = atan2(float(to.y) - cy, float(to.x) - cx) - a0;
+      if(clockwise && sweep >= 0.0f)
+        sweep -= 2.0f * PI;
+      else if(!clockwise && sweep <= 0.0f)
+        sweep += 2.0f * PI;
+
+      // lines
+      float angle = PI;
+      if(float(arcTolerance) < r)
+        angle = 2.0f * acos(1.0f - float(arcTolerance) / r);
+      float n = ceil(fabs(sweep) / angle);
+      arc.count = arc.left = n < 65535.0f ? (unsigned int)n : 65535U;
+      float phi = sweep / float(arc.count);
+      float s = sin(0.5f * phi);
+      arc.sine = long(sin(phi) * float(1L << ROT_SHIFT));
+      arc.versine = long(2.0f * s * s * float(1L << ROT_SHIFT));
+      arc.cx = long(cx * float(1L << ARC_SHIFT));
+      arc.cy = long(cy * float(1L << ARC_SHIFT));
+      arc.ox = from.x * (1L << ARC_SHIFT) - arc.cx;
+      arc.oy = from.y * (1L << ARC_SHIFT) - arc.cy;
+      arc.end = to;
+
+      // bounding box: both ends, and the sides of the circle the arc goes through
+      arc.min = vec2(std::min(from.x, to.x), std::min(from.y, to.y));
+      arc.max = vec2(std::max(from.x, to.x), std::max(from.y, to.y));
+      for(uint8_t k = 0; k < 4; ++k){
+        float t = fmod(clockwise ? a0 - k * HALF_PI : k * HALF_PI - a0, 2.0f * PI);
+        if(t < 0.0f)
+          t += 2.0f * PI;
+        if(t >= fabs(sweep))
+          continue;
+        switch(k){
+          case 0: arc.max.x = std::max(arc.max.x, long(ceil(cx + r))); break;
+          case 1: arc.max.y = std::max(arc.max.y, long(ceil(cy + r))); break;
+          case 2: arc.min.x = std::min(arc.min.x, long(floor(cx - r))); break;
+          case 3: arc.min.y = std::min(arc.min.y, long(floor(cy - r))); break;
+        }
+      }
+      return true;
+    }
+    // next point of the arc, turning the offset from the center by the angle of a line
+    vec2 nextArcPoint(){
+      if(--arc.left == 0)
+        return arc.end;
+      long x = arc.ox, y = arc.oy;
+      arc.ox -= long((int64_t(x) * arc.versine + int64_t(y) * arc.sine) >> ROT_SHIFT);
+      arc.oy -= long((int64_t(y) * arc.versine - int64_t(x) * arc.sine) >> ROT_SHIFT);
+      static const long half = 1L << (ARC_SHIFT - 1);
+      return vec2((arc.cx + arc.ox + half) >> ARC_SHIFT, (arc.cy + arc.oy + half) >> ARC_SHIFT);
+    }
+    // queue the next lines of the arc, until the lookahead is full
+    void feedArc(){
+      while(arc.left && !locXY->isQueueFull()){
+        vec2 xy = locXY->target();
+        vec2 trg = nextArcPoint();
+        long ride[Locator::MAX_RIDERS] = { 0L };
+        if(extrudesAlong())
+          ride[E_RIDER] = extrusionAlong(trg - xy);
+        if(arc.dz){
+          // z of the helix at this point, from the start of the arc
+          unsigned int k = arc.count - arc.left;
+          long z = long(int64_t(arc.dz) * k / arc.count);
+          ride[Z_RIDER] = z - arc.z;
+          arc.z = z;
+        }
+        locXY->queueTarget(trg, ride, feedAlong(feed, trg - xy, ride[Z_RIDER]));
+        if(ride[Z_RIDER])
+          locZ->ride(locZ->target() + ride[Z_RIDER]);
+        if(error){
+          arc.left = 0;
+          return;
+        }
+      }
+    }
     void simulateMoveCommand(int id){
       switch(id){
         // --- linear movement
@@ -339,10 +616,21 @@ namespace gcode {
           }
         } break;
 
-        // --- rotation (NOT SUPPORTED)
+        // --- circular movement
         case 2:
         case 3: {
-          
+          vec2 from(lastX, lastY);
+          if(!startArc(from, id == 2))
+            break;
+          arc.left = 0; // nothing to queue
+          lastX = arc.end.x;
+          lastY = arc.end.y;
+          desc.end += arc.end - from;
+          // set boundaries to include the arc (relative to the start, as the end)
+          desc.min.x = std::min(desc.min.x, desc.end.x - arc.end.x + arc.min.x);
+          desc.min.y = std::min(desc.min.y, desc.end.y - arc.end.y + arc.min.y);
+          desc.max.x = std::max(desc.max.x, desc.end.x - arc.end.x + arc.max.x);
+          desc.max.y = std::max(desc.max.y, desc.end.y - arc.end.y + arc.max.y);
         } break;
 
         // --- metric system
@@ -404,14 +692,33 @@ namespace gcode {
     int G;
     long X, Y, Z, A, E, F;
     bool hasX, hasY, hasZ, hasA, hasE, hasF;
+    long I, J, R; // arc center offset or radius
+    bool hasI, hasJ, hasR;
     long lastE;
+    long flow;    // extrusion speed of the current level (steps/s)
+    float Ecarry; // extrusion left from the previous lines (see extrusionAlong())
+    unsigned long feed; // path speed of the moves (steps/s, 0 = best speed of the planner)
     bool absolute, metric;
+    bool pending; // move command waiting for the queued ones
     // extra parameters
     long P, S;
 
     // parameters
     float scale;
 
+    // arc being queued (see startArc())
+    static const uint8_t ARC_SHIFT = 8;  // fixed point of the offsets (1/256 steps)
+    static const uint8_t ROT_SHIFT = 30; // fixed point of the rotation
+    struct Arc {
+      long cx, cy;          // center
+      long ox, oy;          // offset of the last point from the center
+      long sine, versine;   // rotation of a line: sin, 1 - cos (small angles keep their precision)
+      vec2 end;
+      vec2 min, max;        // bounding box
+      long dz, z;           // z distance of a helix, and so far
+      unsigned int count, left; // lines
+    } arc;
+
     // description
     Description desc;
     long lastX, lastY;
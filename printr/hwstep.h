@@ -0,0 +1,286 @@
+#pragma once
+
+#include "Arduino.h"
+#include "utils.h"
+#include "pins.h"
+#include "ticker.h"
+#include "timing.h"
+
+/**
+ * Hardware step generation, one 16-bit timer per axis.
+ *
+ * Each channel runs its timer (1, 3, 4 or 5) in CTC mode with two compare
+ * matches per step (one for each edge), so that the period of an axis is
+ * exact to the CPU clock and does not depend on the step tick nor on the
+ * other axes. When the step pin is an output compare pin of its timer
+ * (e.g. OC3B = pin 2, OC4C = pin 8), the timer toggles it directly and
+ * the steps have no jitter; otherwise a minimal interrupt toggles it.
+ * The interrupt also counts the matches (the position is reconstructed
+ * from them) and stops the timer on a low pin, when requested
+ * or after a given number of steps (see setLimit()), and records the
+ * lateness of the steps it toggles (see timing.h).
+ *
+ * Without AVR hardware (host build), the timers are emulated
+ * from the virtual time of the ticker.
+ */
+#if defined(__AVR_ATmega2560__) || defined(__AVR_ATmega1280__)
+#define HWSTEP_TIMERS
+#endif
+
+namespace hwstep {
+
+  enum Channel {
+    TIMER1 = 0,
+    TIMER3,
+    TIMER4,
+    TIMER5,
+    NUM_CHANNELS
+  };
+  static const long MAX_RATE = 20000L;   // steps/s
+
+  // state of each channel
+  volatile unsigned long toggles[NUM_CHANNELS]; // compare matches since reset()
+  volatile unsigned long limit[NUM_CHANNELS];   // matches before stopping
+  volatile bool limited[NUM_CHANNELS];
+  volatile bool running[NUM_CHANNELS];
+  volatile bool stopping[NUM_CHANNELS];
+  unsigned long rate[NUM_CHANNELS];
+  Pin pins[NUM_CHANNELS]; // step pin
+  uint8_t axis[NUM_CHANNELS]; // of the stepper (see timing.h)
+  uint8_t outputs[NUM_CHANNELS]; // compare output mode of the pin (0 = from the interrupt)
+
+#ifdef HWSTEP_TIMERS
+  // data space address of TCCRnA, followed by TCCRnB (+1), TCNTn (+4) and OCRnA/B/C (+8/10/12)
+  constexpr uint16_t TIMER_ADDRESS[] = { 0x80, 0x90, 0xA0, 0x120 };
+  constexpr uint16_t TIMSK_ADDRESS[] = { 0x6F, 0x71, 0x72, 0x73 };
+  constexpr uint16_t TIFR_ADDRESS[]  = { 0x36, 0x38, 0x39, 0x3A };
+  // output compare pins (A, B, C) of each timer
+  constexpr uint8_t OC_PINS[NUM_CHANNELS][3] = {
+    { 11, 12, 13 }, { 5, 2, 3 }, { 6, 7, 8 }, { 46, 45, 44 }
+  };
+  // clock select bits and prescaler values (same for all the timers)
+  static const uint8_t NUM_PRESCALERS = 5;
+  static const uint16_t PRESCALERS[NUM_PRESCALERS] = { 1, 8, 64, 256, 1024 };
+  static const uint8_t PRESCALER_SHIFTS[NUM_PRESCALERS] = { 0, 3, 6, 8, 10 };
+  static const unsigned long CYCLES_PER_US = F_CPU / 1000000UL;
+  uint8_t prescaler[NUM_CHANNELS];
+
+  inline volatile uint8_t &reg8(uint8_t c, uint8_t offset) {
+    return *(volatile uint8_t *)(TIMER_ADDRESS[c] + offset);
+  }
+  inline volatile uint16_t &reg16(uint8_t c, uint8_t offset) {
+    return *(volatile uint16_t *)(TIMER_ADDRESS[c] + offset);
+  }
+  inline volatile uint8_t &timsk(uint8_t c) {
+    return *(volatile uint8_t *)TIMSK_ADDRESS[c];
+  }
+  inline volatile uint8_t &tifr(uint8_t c) {
+    return *(volatile uint8_t *)TIFR_ADDRESS[c];
+  }
+
+  /**
+   * Register the step pin of a channel
+   */
+  void attach(uint8_t c, const Pin &pin, uint8_t a) {
+    pins[c] = pin;
+    axis[c] = a;
+    outputs[c] = 0;
+    for(uint8_t i = 0; i < 3; ++i){
+      if(OC_PINS[c][i] == pin.number())
+        outputs[c] = _BV(COM1A0) >> (2 * i); // toggle OCnx on compare match
+    }
+  }
+
+  void halt(uint8_t c) {
+    reg8(c, 1) = 0;           // no clock
+    reg8(c, 0) = 0;           // OCnx disconnected (pin back to its port, low)
+    timsk(c) &= ~_BV(OCIE1A);
+    running[c] = stopping[c] = false;
+  }
+
+  /**
+   * Step at v steps/s (v > 0), starting the timer if needed
+   */
+  void setRate(uint8_t c, unsigned long v) {
+    if(!v) return;
+    if(v > (unsigned long)MAX_RATE) v = MAX_RATE;
+    // two matches per step, with the finest prescaler that fits
+    uint8_t cs = 0;
+    unsigned long top = F_CPU / (2UL * v);
+    while(top > 65536UL && cs + 1 < NUM_PRESCALERS){
+      ++cs;
+      top = F_CPU / (2UL * v * PRESCALERS[cs]);
+    }
+    if(top > 65536UL) top = 65536UL;
+    CriticalSection cs_lock;
+    if(limited[c] && toggles[c] >= limit[c])
+      return; // done
+    rate[c] = v;
+    prescaler[c] = cs;
+    // toggle on the match that resets the counter
+    uint16_t ocr = uint16_t(top - 1UL);
+    reg16(c, 8) = ocr;  // OCRnA (top)
+    reg16(c, 10) = ocr; // OCRnB
+    reg16(c, 12) = ocr; // OCRnC
+    if(reg16(c, 4) >= ocr) reg16(c, 4) = 0; // OCRnA is not buffered in CTC mode
+    stopping[c] = false;
+    if(!running[c]){
+      reg16(c, 4) = 0;
+      reg8(c, 0) = outputs[c];
+      tifr(c) = _BV(OCF1A);
+      timsk(c) |= _BV(OCIE1A);
+      running[c] = true;
+    }
+    reg8(c, 1) = _BV(WGM12) | (cs + 1); // CTC on OCRnA
+  }
+
+  /**
+   * Stop after the current step (the pin ends low): right away on a low
+   * pin, otherwise on the next match (at most one compare period), so
+   * that callers poll isRunning() instead of waiting here
+   */
+  void stop(uint8_t c) {
+    CriticalSection cs;
+    if(!running[c]) return;
+    if(!(toggles[c] & 1UL)){
+      halt(c); // already low
+      return;
+    }
+    stopping[c] = true;
+  }
+
+  // compare match (interrupt)
+  inline void compare(uint8_t c) {
+    unsigned long t = ++toggles[c];
+    if(!outputs[c]){
+      if(t & 1UL){
+        pins[c].high();
+        // late by the counts since the match (the counter restarts on it)
+        unsigned long cycles = (unsigned long)reg16(c, 4) << PRESCALER_SHIFTS[prescaler[c]];
+        timing::timed(axis[c], (unsigned int)(cycles / CYCLES_PER_US));
+      } else
+        pins[c].low();
+    } else if(t & 1UL)
+      timing::timed(axis[c], 0); // toggled by the match itself
+    if(!(t & 1UL) && (stopping[c] || (limited[c] && t >= limit[c])))
+      halt(c);
+  }
+#else
+  unsigned long startTime[NUM_CHANNELS];
+  double startToggles[NUM_CHANNELS]; // with the phase of the counter
+
+  void attach(uint8_t c, const Pin &pin, uint8_t a) {
+    pins[c] = pin;
+    axis[c] = a;
+    outputs[c] = 0;
+  }
+
+  double position(uint8_t c) {
+    return startToggles[c] + double(ticker::virtualTime - startTime[c]) * 2.0 * rate[c] / 1e6;
+  }
+
+  void sync(uint8_t c) {
+    if(!running[c]) return;
+    unsigned long t = toggles[c];
+    toggles[c] = (unsigned long)position(c);
+    if(limited[c] && toggles[c] >= limit[c]){
+      toggles[c] = limit[c];
+      running[c] = false;
+    }
+    // rising edges on their exact time
+    unsigned long n = (toggles[c] + 1UL) / 2UL - (t + 1UL) / 2UL;
+    if(n)
+      timing::timed(axis[c], 0, n);
+  }
+
+  void halt(uint8_t c) {
+    sync(c);
+    running[c] = stopping[c] = false;
+  }
+
+  void setRate(uint8_t c, unsigned long v) {
+    if(!v) return;
+    if(v > (unsigned long)MAX_RATE) v = MAX_RATE;
+    sync(c);
+    if(limited[c] && toggles[c] >= limit[c])
+      return; // done
+    startToggles[c] = running[c] ? position(c) : double(toggles[c]);
+    startTime[c] = ticker::virtualTime;
+    rate[c] = v;
+    running[c] = true;
+  }
+
+  void stop(uint8_t c) {
+    if(!running[c]) return;
+    halt(c); // emulated: the current step ends right away
+    toggles[c] += toggles[c] & 1UL; // finish the current step
+  }
+#endif
+
+  // --- setters ---------------------------------------------------------------
+  // stop by itself after n steps since reset()
+  void setLimit(uint8_t c, unsigned long n) {
+    CriticalSection cs;
+    limit[c] = 2UL * n;
+    limited[c] = true;
+  }
+
+  // --- getters ---------------------------------------------------------------
+  // steps (rising edges) since reset()
+  unsigned long steps(uint8_t c) {
+#ifndef HWSTEP_TIMERS
+    sync(c);
+#endif
+    CriticalSection cs;
+    return (toggles[c] + 1UL) / 2UL;
+  }
+  bool isRunning(uint8_t c) {
+#ifndef HWSTEP_TIMERS
+    sync(c);
+#endif
+    return running[c];
+  }
+  bool hasLimit(uint8_t c) {
+    return limited[c];
+  }
+  // steps left before the limit
+  unsigned long stepsLeft(uint8_t c) {
+    if(!limited[c]) return 0UL;
+    unsigned long n = steps(c);
+    return n < limit[c] / 2UL ? limit[c] / 2UL - n : 0UL;
+  }
+  // whether the limit has been reached (and the timer stopped)
+  bool isDone(uint8_t c) {
+    if(!limited[c]) return false;
+#ifndef HWSTEP_TIMERS
+    sync(c);
+#endif
+    CriticalSection cs;
+    return !running[c] && toggles[c] >= limit[c];
+  }
+
+  // clear the step count and the limit (when stopped)
+  void reset(uint8_t c) {
+    CriticalSection cs;
+    if(!running[c]){
+      toggles[c] = 0UL;
+      limited[c] = false;
+    }
+  }
+
+}
+
+#ifdef HWSTEP_TIMERS
+ISR(TIMER1_COMPA_vect) {
+  hwstep::compare(hwstep::TIMER1);
+}
+ISR(TIMER3_COMPA_vect) {
+  hwstep::compare(hwstep::TIMER3);
+}
+ISR(TIMER4_COMPA_vect) {
+  hwstep::compare(hwstep::TIMER4);
+}
+ISR(TIMER5_COMPA_vect) {
+  hwstep::compare(hwstep::TIMER5);
+}
+#endif
@@ -10,38 +10,76 @@ public:
 
 	typedef void (*Callback)(int state);
 
+	// lookahead of the queued targets (see queueTarget()),
+	// 81 bytes of RAM per segment on the board
+	static const uint8_t LOOKAHEAD = 8; // segments (power of two)
+	static const unsigned long DEFAULT_DEVIATION = 4UL; // 1/16 microsteps
+	// other axes carried along the lines (see setRider())
+	static const uint8_t MAX_RIDERS = 2;
+	// axes of the lines: x, y, then the riders (see stepper())
+	static const uint8_t NUM_AXES = 2 + MAX_RIDERS;
+
+	/**
+	 * Trapezoidal speed profile of the major axis along a line (steps/s),
+	 * computed once when the line is planned: up to v_cruise, then down to
+	 * v_exit from the brake distance on (see profileOf())
+	 */
+	struct Profile {
+		long v_entry, v_end;     // planned entry and exit (inputs)
+		long v_cruise, v_exit;
+		unsigned long brake;     // distance left when braking starts (1/16 microsteps)
+		unsigned long time;      // duration (us)
+	};
+
+	/**
+	 * Segment of the path towards a target, with its limits along the path
+	 * (path speeds: the major axis runs at their share of the length)
+	 */
+	struct Segment {
+		vec2 target;
+		float ux, uy;     // direction
+		float length;     // 1/16 microsteps
+		float share;      // major distance / length
+		float v_max;      // path speed limit (steps/s)
+		float accel;      // path acceleration (steps/s²)
+		float v_junction; // fastest entry through the corner (steps/s)
+		float v_entry;    // planned entry (steps/s)
+		uint8_t axis;            // major axis, the longest one (riders included)
+		unsigned long distance;  // along the major axis (1/16 microsteps)
+		long v_top;              // fastest speed of the major axis, for the others (steps/s)
+		long ride[MAX_RIDERS];   // distances of the riders (1/16 microsteps)
+		Profile profile;
+	};
+
 	Locator(Stepper *x, Stepper *y) : stpX(x), stpY(y) {
+		for(uint8_t i = 0; i < MAX_RIDERS; ++i)
+			riders[i] = NULL;
+		for(uint8_t k = 0; k < NUM_AXES; ++k)
+			axisLeft[k] = 0UL; // see endLine()
 		reset();
 	}
 	
-	vec2 bestFreq(const vec2 &delta, unsigned long f_best){
-		vec2 abs = delta.abs();
-		long d_max = abs.max();
-		vec2 f;
-		for(int i = 0; i < 2; ++i){
-			if(abs[i] == d_max){
-				f[i] = sign(delta[i]) * f_best;
-			} else if(abs[i] <= stepper(i)->stepSize()) {
-				f[i] = 0L;
-			} else {
-				f[i] = (long)std::round(f_best * d_max / float(delta[i]));
-        // /!\ this can raise values lower than f_best
-        // => replace by (+/-)f_best in these cases
-        if(std::abs(f[i]) < f_best){
-          f[i] = sign(delta[i]) * f_best;
-        }
-			}
-		}
-		return f;
-	}
-  vec2 bestFreq(const vec2 &delta){
-   return bestFreq(delta, f_best);
-  }
-	
 	void update(){
     // should we work or not?
     if(!enabled) return;
-    
+    if(usesTimers()){
+      // distances left from the step timers
+      majorLeft = stepper(majorAxis)->timerLeft();
+      axisLeft[1 - majorAxis] = stepper(1 - majorAxis)->timerLeft();
+    }
+    // segments started by the tick at the junctions
+    syncSegments();
+    // more targets for the lookahead
+    if(feeder && !isQueueFull()){
+      feeder(state);
+    }
+    // recompute on events only: new targets or settings, and those of the
+    // axes (see Stepper::takeEvent), the step timers are followed every time
+    bool x = stpX->takeEvent(), y = stpY->takeEvent();
+    if(!dirty && !x && !y && !usesTimers())
+      return;
+    dirty = false;
+
 		// - should we be idle?
 		if(!hasTarget()){
       if(debugMode > 1) Serial.println("No target.");
@@ -49,193 +87,170 @@ public:
 		  if(isMoving()){
   			for(int i = 0; i < 2; ++i){
   				Stepper *stp = stepper(i);
+          stp->unfollow();
           if(!stp->lowMicrostep()){
             stp->microstep(Stepper::MS_SLOW);
           }
-  				if(stp->targetFreq() != Stepper::IDLE_FREQ)
-  					stp->moveToFreq(Stepper::IDLE_FREQ);
+  				if(stp->targetSpeed() != Stepper::IDLE_SPEED)
+  					stp->moveToSpeed(Stepper::IDLE_SPEED);
   			}
   		}
       return;
 		}
 		
-		// target reach state
-		bool reached = hasReachedTarget();
-		
 		// - did we reach the target
-		if(reached){
-			unsigned long lastID = targetID;
-			// callback (mostly to get the new next target)
-			if(callback){
-				callback(state);
-			}
-			if(lastID == targetID){
-				// shift targets since we have no new target
-			  lastTarget = currTarget; // => hasTarget() == false
-			}
-		}
-		
-    vec2 delta = realDelta();
-		// - should we stop at the target?
-		if(isEnding()){
-			long x0 = stpX->stepsToFreq(Stepper::IDLE_FREQ),
-					 y0 = stpY->stepsToFreq(Stepper::IDLE_FREQ);
-			// should we start slowing down?
-			vec2 targetFreq;
-			if((currTarget - vec2(x0, y0)).sqLength() < epsilonSq){
-        if(debugMode > 1){
-          Serial.print("Ending stop in "); Serial.print(x0); Serial.print(", "); Serial.print(y0);
-          Serial.print(" for target "); Serial.print(currTarget.x); Serial.print(", "); Serial.print(currTarget.y);
-          Serial.print(" | curFreq "); Serial.print(stpX->currentFreq()); Serial.print(", "); Serial.println(stpY->currentFreq());
-        }
-        // targetFreq = bestFreq(delta);
-				// it will take us enough time to stop
-				// that we should start slowing down now!
-				targetFreq = bestFreq(delta, currentFreq().abs().max() + 1L); // vec2(Stepper::IDLE_FREQ);
-        // TODO this change is a HACK, it's not intended (most likely valueAtFreq is wrong instead)
+		if(hasReachedTarget()){
+			if(numQueued){
+				// the tick takes the next segment over at the junction,
+				// or it starts from here (step timers, or not prepared in time)
+				if(isJunctionDue())
+					return;
+				popSegment();
+				ending = true;
+				startLine(currTarget - value(), current.ride);
 			} else {
-				targetFreq = bestFreq(delta);
-        if(debugMode > 1){
-          Serial.print("delta: "); Serial.print(delta.x); Serial.print(", "); Serial.print(delta.y);
-          Serial.print(" => trgFreq "); Serial.print(targetFreq.x); Serial.print(", "); Serial.print(targetFreq.y);
-          Serial.print(" | curFreq "); Serial.print(stpX->currentFreq()); Serial.print(", "); Serial.println(stpY->currentFreq());
-        }
+				unsigned long lastID = targetID;
+				// callback (mostly to get the new next target)
+				if(callback){
+					callback(state);
+				}
+				if(lastID == targetID){
+					// shift targets since we have no new target
+				  lastTarget = currTarget; // => hasTarget() == false
+					// the feeder may have waited for the stop
+					if(feeder)
+						feeder(state);
+					if(lastID == targetID)
+						return;
+				}
 			}
-			adjustToFreq(targetFreq, delta);
-		} else
+		}
+		// the next segment for the junction
+		prepareNext();
 		
-		// - we must make our line as straight as possible
+		// - drive the major axis along its profile (braking starts in tick()),
+		//   the others follow in tick(), or the minor one at the speed ratio
+		//   of the line with step timers
+		Stepper *major = stepper(majorAxis);
+		long v_trg;
 		{
-      if(debugMode > 1) Serial.println("Straight line");
-			adjustToFreq(bestFreq(delta), delta);
+			CriticalSection cs;
+			if(switches != seenSwitches)
+				return; // the tick just started the next segment
+			if(usesTimers() && majorLeft <= profile.brake)
+				braking = true;
+			v_trg = majorDir * (braking ? profile.v_exit : profile.v_cruise);
+			if(!majorLeft)
+				v_trg = Stepper::IDLE_SPEED; // halted at its end, while the others finish
+			major->setAcceleration(accel);
+			major->setJerk(jerk);
+			if(major->targetSpeed() != v_trg){
+				major->moveToSpeed(v_trg);
+			}
+		}
+		if(debugMode > 2){
+			Serial.print("major "); Serial.print(majorAxis); Serial.print(", left "); Serial.print(stepsLeftToTarget());
+			Serial.print(" => trgSpeed "); Serial.print(v_trg); Serial.print(" | curSpeed "); Serial.println(major->currentSpeed());
+		}
+		if(usesTimers()){
+			int m = 1 - majorAxis;
+			Stepper *minor = stepper(m);
+			float ratio = majorTotal ? float(axisTotal[m]) / float(majorTotal) : 0.0f;
+			minor->setAcceleration(std::max(1UL, (unsigned long)(float(accel) * ratio)));
+			minor->setJerk((unsigned long)(float(jerk) * ratio));
+			long v_minor = axisDir[m] * long(float(std::abs(major->currentSpeed())) * ratio);
+			if(!majorLeft && axisLeft[m])
+				v_minor = axisDir[m] * minor->startSpeed(); // rounding leftover
+			else if(!axisLeft[m])
+				v_minor = Stepper::IDLE_SPEED; // done, the timer would not stop it again
+			if(minor->targetSpeed() != v_minor)
+				minor->moveToSpeed(v_minor);
 		}
 	}
-	
-	static unsigned long deltaTime(unsigned long t1, unsigned long t2){
-		return std::max(t1, t2) - std::min(t1, t2); // won't underflow
-	}
-	
-	void adjustToFreq(vec2 f_trg, const vec2 &delta){
-		unsigned long df[2] = { df_max, df_max };
-		unsigned long t[2] = { stpX->timeToFreq(f_trg[0], df[0]), stpY->timeToFreq(f_trg[1], df[1]) };
-		unsigned long dt = deltaTime(t[0], t[1]);
-		// optimize for df and f_trg, so that abs(t[0] - t[1]) is lowest
-		bool opt = true;
-		unsigned long it = 0;
-		while(opt && it < 1000){
-			++it;
-			opt = false; // by default, we stop optimizing if nothing changes
-			
-			// augmenting (first!)
-			for(int i = 0; i < 2; ++i){
-				if(df[i] < df_max){
-					t[i] = stepper(i)->timeToFreq(f_trg[i], df[i] + 1);
-					unsigned long dt2 = deltaTime(t[0], t[1]);
-					if(dt2 < dt){
-						df[i] += 1; // increment since it gets better
-						dt = dt2;
-						opt = true;
-						break;
-					}
-				}
-			}
-			// bias towards increase in acceleration
-			if(opt) continue;
-			
-			// reducing (if augmenting does not help)
-			for(int i = 0; i < 2; ++i){
-				if(df[i] > 1){
-					t[i] = stepper(i)->timeToFreq(f_trg[i], df[i] - 1);
-					unsigned long dt2 = deltaTime(t[0], t[1]);
-					if(dt2 < dt){
-						df[i] -= 1; // decrement since it gets better
-						dt = dt2;
-						opt = true;
-						break;
-					}
+
+	/**
+	 * Line interpolation (DDA), called in the rising phase of the tick,
+	 * after the steppers have been executed.
+	 * Distances are in 1/16 microsteps: each step of the major axis, the
+	 * longest one, owes the other axes a Bresenham increment (at most its own
+	 * size), which they pay in steps of their own gear, so that all the axes
+	 * end on the exact target together.
+	 */
+	void tick(){
+		if(!majorLeft && !hasFollowLeft()){
+			if(nextReady)
+				startNext();
+			else if(hasAdvanceLeft())
+				followTick(stepper(majorAxis)); // after the last line
+			return;
+		}
+		if(usesTimers()) return; // see update()
+		Stepper *major = stepper(majorAxis);
+		unsigned long d = major->pulseSize();
+		if(d && majorLeft && major->direction() == majorDir){
+			majorLeft -= d;
+			for(uint8_t k = 0; k < NUM_AXES; ++k){
+				if(!axisLeft[k]) continue;
+				residual[k] += d * axisTotal[k];
+				while(residual[k] >= majorTotal){
+					residual[k] -= majorTotal;
+					++owed[k];
 				}
 			}
-
-      /*
-			// increasing the period globally
-			if(f_trg.x != 0L && f_trg.y != 0L){
-				vec2 f_new = f_trg * 2L;
-				for(int i = 0; i < 2; ++i)
-					t[i] = stepper(i)->timeToFreq(f_new[i], df[i]);
-				unsigned long dt2 = deltaTime(t[0], t[1]);
-				if(dt2 < dt){
-					f_trg = f_new;
-					dt = dt2;
-					opt = true;
+			if(!majorLeft){
+				major->halt(); // exact end of the line
+				dirty = majorAxis >= 2; // no event from x and y (see update())
+			} else {
+				major->limitGear(majorLeft);
+				if(!braking && majorLeft <= profile.brake){
+					braking = true; // planned deceleration
+					major->moveToSpeed(majorDir * profile.v_exit);
 				}
 			}
-     */
-		}
-
-    /*
-    // acceleration using ms
-    long f_x = std::abs(stpX->currentFreq());
-    long f_y = std::abs(stpY->currentFreq());
-    vec2 d = delta.abs();
-    bool msX = f_x == 1L && std::abs(stpX->targetFreq()) == 1L;
-    bool msY = f_y == 1L && std::abs(stpY->targetFreq()) == 1L;
-    if(d.sqLength() > 5000L * 5000L){
-      if(d.x == 0L || d.y > 5L * d.x){
-        stpY->microstep(Stepper::MS_1_4);
-        f_trg[0] /= 4;
-      } else if(d.y == 0L || d.x > 5L * d.y){
-        stpX->microstep(Stepper::MS_1_4);
-        f_trg[1] /= 4;
-      } else {
-        msX = msY = false;
-      }
-    } else if(d.sqLength() > 1000L * 1000L){
-      if(d.x == 0L || d.y > 5L * d.x){
-        stpY->microstep(Stepper::MS_1_8);
-        f_trg[0] /= 2;
-      } else if(d.y == 0L || d.x > 5L * d.y){
-        stpX->microstep(Stepper::MS_1_8);
-        f_trg[1] /= 2;
-      } else {
-        msX = msY = false;
-      }
-    } else {
-      msX = msY = false;
-    }
-    
-    if(!msX && !stpX->lowMicrostep()){
-      stpX->microstep(Stepper::MS_SLOW);
-    }
-    if(!msY && !stpY->lowMicrostep()){
-      stpY->microstep(Stepper::MS_SLOW);
-    }
-    */
-    
-		// done, we update the parameters of both stepper motors
-		for(int i = 0; i < 2; ++i){
-      if(debugMode > 2){
-        Serial.print("dt "); Serial.print(df[i], DEC); Serial.print(", f_trg "); Serial.println(f_trg[i]);
-      }
-			stepper(i)->setDeltaFreq(df[i]);
-			stepper(i)->moveToFreq(f_trg[i]); // TODO these don't work correctly! => bug in updateFreq
 		}
+		followTick(major);
+		// junction: the next segment goes on without stopping
+		if(!majorLeft && nextReady && !hasFollowLeft())
+			startNext();
 	}
 	
 	// --- setters ---------------------------------------------------------------
-	void setTarget(const vec2 &trg, bool end = true){
+	/**
+	 * Pressure advance of a rider (ms), e.g. the extrusion of viscous dough:
+	 * it runs ahead of the line by the distance it goes in that time at the
+	 * current speed, which pushes more while accelerating, and less (or back)
+	 * while decelerating. The advance carries over the junctions.
+	 */
+	void setAdvance(const Stepper *stp, unsigned long k){
+		for(uint8_t i = 0; i < MAX_RIDERS; ++i){
+			if(riders[i] == stp){
+				rideK[i] = k;
+				return;
+			}
+		}
+		error = ERR_INVALID_ACCESSOR;
+	}
+	void setTarget(const vec2 &trg, bool end = true, const long *ride = NULL, unsigned long feed = 0UL){
+		// soft limits, checked once here (see Stepper::guardBounds)
+		if(!isValidTarget(trg)){
+			error = ERR_OUT_OF_BOUNDS;
+			return;
+		}
 		// shift targets
 		lastTarget = currTarget;
 		currTarget = trg;
    
 		// movement state
 		ending = end;
-   
-    // reset memory so that we can move optimally
-    stpX->resetMemory();
-    stpY->resetMemory();
+		clearQueue();
+		current = segmentTo(value(), currTarget, ride, feed);
+
+    // line from the current position
+    startLine(currTarget - value(), current.ride);
     
 		// update target id
 		++targetID;
+		dirty = true;
    
    if(debugMode){
       Serial.print("New targets: ");
@@ -244,50 +259,146 @@ public:
       Serial.print("Current: "); Serial.print(stpX->value()); Serial.print(", "); Serial.println(stpY->value());
     }
 	}
+	/**
+	 * Append a target to the lookahead (e.g. the lines of a gcode file).
+	 * The path goes through the junctions without stopping, at the speed
+	 * of their corner (junction deviation), planned backward from a stop
+	 * at the last target and forward from the current speed.
+	 * The riders move by their distances (if any) along the same segment,
+	 * and the path speed stays below the feedrate of the move (if any).
+	 */
+	void queueTarget(const vec2 &trg, const long *ride = NULL, unsigned long feed = 0UL){
+		if(!isValidTarget(trg)){
+			error = ERR_OUT_OF_BOUNDS;
+			return;
+		}
+		for(uint8_t i = 0; ride && i < MAX_RIDERS; ++i){
+			if(ride[i] && !canRide(i)){
+				error = ERR_MIXED_TIMERS; // the riders follow the tick
+				return;
+			}
+		}
+		if(!hasTarget()){
+			setTarget(trg, true, ride, feed);
+			return;
+		}
+		if(isQueueFull()){
+			error = ERR_SEGMENT_OVERFLOW;
+			return;
+		}
+		const Segment &last = numQueued ? queue[(head + numQueued - 1) & (LOOKAHEAD - 1)] : current;
+		if(trg == last.target)
+			return; // no move
+		Segment seg = segmentTo(last.target, trg, ride, feed);
+		seg.v_junction = junctionSpeed(last, seg);
+		queue[(head + numQueued) & (LOOKAHEAD - 1)] = seg;
+		++numQueued;
+		replan();
+		dirty = true;
+	}
   void resetX(long x){
+    endLine();
     stpX->resetPosition(x);
     lastTarget.x = currTarget.x = x;
   }
   void resetY(long y){
+    endLine();
     stpY->resetPosition(y);
     lastTarget.y = currTarget.y = y;
   }
-	void setBestFreq(unsigned long f){
-		if(f)
-			f_best = f;
+	// speed of the major axis (steps/s)
+	void setBestSpeed(unsigned long v){
+		if(v)
+			v_best = v;
+		dirty = true;
+	}
+	// acceleration of the major axis (steps/s²)
+	void setAcceleration(unsigned long a){
+		if(a)
+			accel = a;
+		dirty = true;
 	}
-	void setMaxDeltaFreq(unsigned long df){
-		if(df)
-			df_max = df;
+	// jerk of the major axis (steps/s³), 0 for constant accelerations
+	void setJerk(unsigned long j){
+		jerk = j;
+		dirty = true;
 	}
 	void setPrecision(unsigned long eps){
 		epsilon = eps;
     epsilonSq = std::max(1UL, eps * eps);
 	}
+	// largest distance between the path and its corners (1/16 microsteps),
+	// 0 = stop at every corner
+	void setDeviation(unsigned long d){
+		deviation = d;
+	}
 	void setCallback(Callback cb){
 		callback = cb;
 	}
+	// called while the lookahead has room, to queue the next targets
+	void setFeeder(Callback cb){
+		feeder = cb;
+	}
 	void setState(int s0){
 		state = s0;
 	}
+	/**
+	 * Carry another axis along the lines (e.g. z), by the distances given
+	 * to setTarget() and queueTarget(): it follows the major axis like the
+	 * minor one (or leads the line when it goes the furthest), so that the
+	 * move starts and ends on all the axes together
+	 */
+	void setRider(uint8_t i, Stepper *stp){
+		if(i >= MAX_RIDERS){
+			error = ERR_INVALID_ACCESSOR;
+			return;
+		}
+		endLine();
+		riders[i] = stp;
+	}
 	void reset() {
-		f_best = 1L;
-		df_max = 1L;
+		v_best = 20000UL; // with gears up to 1/4 (see speeds.h)
+		accel = Stepper::DEFAULT_ACCEL;
+		jerk = 0UL;
 		setPrecision(5UL);
+		deviation = DEFAULT_DEVIATION;
+		for(uint8_t i = 0; i < MAX_RIDERS; ++i)
+			rideK[i] = 0UL;
 		lastTarget = currTarget = value();
     ending = true;
-		callback = NULL;
+    majorAxis = 0;
+    majorDir = 1L;
+    majorTotal = 0UL;
+    head = numQueued = 0;
+    switches = seenSwitches = 0;
+    profile = profileOf(0, 0L, 0L, 0UL, long(v_best));
+    braking = false;
+    endLine();
+		current = segmentTo(currTarget, currTarget);
+		callback = feeder = NULL;
 		state = 0;
     enabled = true;
+    dirty = true;
 	}
   void toggle(){
-    enabled = !enabled;
+    if(enabled)
+      disable();
+    else
+      enable();
   }
   void enable(){
     enabled = true;
+    dirty = true;
   }
   void disable(){
     enabled = false;
+    endLine();
+  }
+  // step both axes with their own timer (see hwstep.h)
+  void useTimers(bool on){
+    endLine();
+    stpX->useTimer(on);
+    stpY->useTimer(on);
   }
 	
 	// --- getters ---------------------------------------------------------------
@@ -296,17 +407,18 @@ public:
 			stpX->value(), stpY->value() //, stpZ->value()
 		);
 	}
+	// last target, queued or not
 	vec2 target() const {
-		return currTarget;
+		return numQueued ? queue[(head + numQueued - 1) & (LOOKAHEAD - 1)].target : currTarget;
 	}
-	vec2 currentFreq() const {
+	vec2 currentSpeed() const {
 		return vec2(
-			stpX->currentFreq(), stpY->currentFreq()
+			stpX->currentSpeed(), stpY->currentSpeed()
 		);
 	}
-	vec2 targetFreq() const {
+	vec2 targetSpeed() const {
 		return vec2(
-			stpX->targetFreq(), stpY->targetFreq()
+			stpX->targetSpeed(), stpY->targetSpeed()
 		);
 	}
 	vec2 currDelta() const {
@@ -315,31 +427,479 @@ public:
 	vec2 realDelta() const {
 		return currTarget - value();
 	}
+	// distance left on the major axis (1/16 microsteps)
+	unsigned long stepsLeftToTarget() const {
+		CriticalSection cs;
+		return majorLeft;
+	}
+	// estimated duration of the planned lines (us): the current one, as last planned, and the queued ones
+	unsigned long plannedTime() const {
+		unsigned long t;
+		{
+			CriticalSection cs;
+			t = majorLeft || hasFollowLeft() ? profile.time : 0UL;
+		}
+		for(uint8_t i = 0; i < numQueued; ++i)
+			t += queue[(head + i) & (LOOKAHEAD - 1)].profile.time;
+		return t;
+	}
 	
 	// --- checks ----------------------------------------------------------------
 	bool hasTarget() const {
-		return lastTarget != currTarget || !hasReachedTarget();
+		return numQueued || lastTarget != currTarget || !hasReachedTarget();
+	}
+	bool isQueueFull() const {
+		return numQueued == LOOKAHEAD;
 	}
 	bool isEnding() const {
 		return ending;
 	}
 	bool hasReachedTarget() const {
-		vec2 r = realDelta(), d = currDelta();
-		return r.dot(d) < 0L
-				|| r.sqLength() <= epsilonSq;
+		// the line ends exactly on the target, unless a boundary stops it close to it
+		CriticalSection cs;
+		if(majorLeft)
+			return stepper(majorAxis)->isBlocked() && (unsigned long)realDelta().sqLength() <= epsilonSq;
+		for(uint8_t k = 0; k < NUM_AXES; ++k){
+			if(axisLeft[k] && !stepper(k)->isBlocked())
+				return false; // paying what the major axis owes it
+		}
+		return true;
 	}
 	bool isMoving() const {
 		return stpX->isRunning() || stpY->isRunning();
 	}
+	bool isValidTarget(const vec2 &p) const {
+		return stpX->isWithinBounds(p.x) && stpY->isWithinBounds(p.y);
+	}
+	bool usesTimers() const {
+		return stpX->usesTimer() && stpY->usesTimer();
+	}
+	// whether rider i moves along the current line or a queued one
+	bool isCarrying(uint8_t i) const {
+		if(i >= MAX_RIDERS)
+			return false;
+		{
+			CriticalSection cs;
+			if(axisLeft[2 + i] || (majorAxis == 2 + i && majorLeft))
+				return true;
+		}
+		for(uint8_t k = 0; k < numQueued; ++k){
+			if(queue[(head + k) & (LOOKAHEAD - 1)].ride[i])
+				return true;
+		}
+		return false;
+	}
+	// whether rider i can move along the lines (tick interpolation only)
+	bool canRide(uint8_t i) const {
+		return i < MAX_RIDERS && riders[i] && !stpX->usesTimer() && !stpY->usesTimer()
+				&& !riders[i]->usesTimer();
+	}
   bool isEnabled() const {
     return enabled;
   }
 	
 protected:
+	// line interpolation of a move, by axis (x, y, then the riders)
+	struct Line {
+		int majorAxis;                   // the longest one
+		long dir[NUM_AXES];
+		unsigned long total[NUM_AXES];   // 1/16 microsteps
+		unsigned long gain[MAX_RIDERS];  // advance of the riders
+		Profile profile; // of the major axis, from the junction
+	};
+
+	void startLine(const vec2 &delta, const long *ride){
+		if(stpX->usesTimer() != stpY->usesTimer()){
+			error = ERR_MIXED_TIMERS;
+			return;
+		}
+		if(usesTimers()){
+			startTimerLine(delta);
+		} else {
+			CriticalSection cs;
+			nextReady = false; // prepared for the previous line
+			setLine(lineOf(delta, ride));
+			Stepper *major = stepper(majorAxis);
+			major->unfollow();
+			major->cancelStop(); // e.g. a z move of an Elevator
+			if(major->currentSpeed() * majorDir < 0L){
+				major->halt(); // the line cannot start in the wrong direction
+			}
+			followLine();
+		}
+		planLine();
+	}
+	// junction (tick): the next segment starts right away, at its planned speed
+	void startNext(){
+		setLine(next);
+		nextReady = false;
+		++switches;
+		profile = next.profile;
+		braking = false;
+		followLine();
+		Stepper *major = stepper(majorAxis);
+		major->lead(majorDir * profile.v_entry);
+		major->moveToSpeed(majorDir * profile.v_cruise);
+	}
+	Line lineOf(const vec2 &delta, const long *ride) const {
+		Line l;
+		// distance on each axis (1/16 microsteps), the riders only go
+		// along an xy line
+		long d[NUM_AXES] = { delta.x, delta.y };
+		for(uint8_t i = 0; i < MAX_RIDERS; ++i)
+			d[2 + i] = delta.x || delta.y ? ride[i] : 0L;
+		l.majorAxis = 0;
+		for(uint8_t k = 0; k < NUM_AXES; ++k){
+			l.total[k] = std::abs(d[k]);
+			l.dir[k] = sign(d[k]);
+			if(l.total[k] > l.total[l.majorAxis])
+				l.majorAxis = k;
+		}
+		unsigned long n = l.total[l.majorAxis];
+		for(uint8_t i = 0; i < MAX_RIDERS; ++i){
+			// advance per speed of the major axis (0.16 fixed-point, see followTick()),
+			// none when the rider leads the line
+			float gain = float(rideK[i]) * 65.536f * float(l.total[2 + i]) / float(std::max(1UL, n));
+			l.gain[i] = l.majorAxis == 2 + i ? 0UL : (unsigned long)std::min(gain, 65535.0f);
+		}
+		return l;
+	}
+	void setLine(const Line &l){
+		majorAxis = l.majorAxis;
+		majorTotal = majorLeft = l.total[majorAxis];
+		majorDir = l.dir[majorAxis];
+		for(uint8_t k = 0; k < NUM_AXES; ++k){
+			axisDir[k] = l.dir[k];
+			axisTotal[k] = axisLeft[k] = k == majorAxis ? 0UL : l.total[k];
+			residual[k] = majorTotal / 2UL; // center the rounding
+			owed[k] = 0UL;
+		}
+		for(uint8_t i = 0; i < MAX_RIDERS; ++i)
+			rideGain[i] = l.gain[i];
+	}
+	// gears of the line, and the other axes following the major one
+	void followLine(){
+		Stepper *major = stepper(majorAxis);
+		major->limitGear(majorLeft);
+		for(uint8_t k = 0; k < NUM_AXES; ++k){
+			if(k == majorAxis || (k >= 2 && !riders[k - 2]))
+				continue;
+			Stepper *stp = stepper(k);
+			if(axisLeft[k]){
+				stp->limitGear(axisLeft[k]);
+				stp->follow(axisDir[k]);
+			} else if(k < 2 || stp->isFollowing()){
+				stp->limitGear(axisLeft[k]);
+				stp->unfollow(); // riders are left alone otherwise (e.g. by an Elevator)
+			}
+		}
+	}
+	// each axis runs its own distance on its step timer
+	void startTimerLine(const vec2 &delta){
+		uvec2 n(std::abs(delta.x), std::abs(delta.y));
+		majorAxis = n.x >= n.y ? 0 : 1;
+		majorTotal = majorLeft = n[majorAxis];
+		majorDir = sign(delta[majorAxis]);
+		for(uint8_t k = 0; k < NUM_AXES; ++k){
+			axisTotal[k] = axisLeft[k] = 0UL; // see canRide()
+			residual[k] = owed[k] = 0UL;
+		}
+		int m = 1 - majorAxis;
+		axisTotal[m] = axisLeft[m] = n[m];
+		axisDir[m] = sign(delta[m]);
+		stpX->moveTimerBy(delta.x);
+		stpY->moveTimerBy(delta.y);
+	}
+	void endLine(){
+		CriticalSection cs;
+		// a rider leading the line stops with it (x and y stop in update())
+		if(majorAxis >= 2 && majorLeft)
+			stepper(majorAxis)->moveToSpeed(Stepper::IDLE_SPEED);
+		majorAxis = 0; // x or y for the step timers (see startTimerLine())
+		majorLeft = 0UL;
+		clearQueue();
+		stpX->unfollow();
+		stpY->unfollow();
+		stpX->limitGear(Stepper::NO_LIMIT);
+		stpY->limitGear(Stepper::NO_LIMIT);
+		for(uint8_t i = 0; i < MAX_RIDERS; ++i){
+			if(axisLeft[2 + i]){
+				riders[i]->unfollow();
+				riders[i]->limitGear(Stepper::NO_LIMIT);
+			}
+			rideGain[i] = 0UL;
+			rideAhead[i] = ridePool[i] = 0L;
+		}
+		for(uint8_t k = 0; k < NUM_AXES; ++k)
+			axisLeft[k] = owed[k] = 0UL;
+	}
+
+	// --- lookahead -------------------------------------------------------------
+	Segment segmentTo(const vec2 &from, const vec2 &to, const long *ride = NULL, unsigned long feed = 0UL) const {
+		Segment seg;
+		seg.target = to;
+		float dx = float(to.x - from.x), dy = float(to.y - from.y);
+		seg.length = sqrt(dx * dx + dy * dy);
+		seg.ux = seg.length > 0.0f ? dx / seg.length : 0.0f;
+		seg.uy = seg.length > 0.0f ? dy / seg.length : 0.0f;
+		seg.share = std::max(std::abs(seg.ux), std::abs(seg.uy));
+		if(seg.share <= 0.0f) seg.share = 1.0f;
+		seg.v_max = float(v_best) / seg.share;
+		seg.accel = float(accel) / seg.share;
+		seg.v_junction = seg.v_entry = 0.0f;
+		uvec2 n(std::abs(to.x - from.x), std::abs(to.y - from.y));
+		seg.axis = n.x >= n.y ? 0 : 1; // see lineOf()
+		seg.distance = n[seg.axis];
+		unsigned long xy = seg.distance;
+		for(uint8_t i = 0; i < MAX_RIDERS; ++i){
+			seg.ride[i] = ride && riders[i] ? ride[i] : 0L;
+			if(xy && (unsigned long)std::abs(seg.ride[i]) > seg.distance){
+				seg.axis = 2 + i; // the rider leads the line
+				seg.distance = std::abs(seg.ride[i]);
+			}
+		}
+		if(seg.axis >= 2){
+			// distance of the major axis along the path
+			seg.share = float(seg.distance) / seg.length;
+			seg.accel = float(accel) / seg.share;
+		}
+		// the others go their distance in the time of the major axis
+		float top = float(v_best) * float(seg.distance) / float(std::max(1UL, xy));
+		if(feed)
+			top = std::min(top, float(feed) * seg.share); // path speed of the move (e.g. gcode feedrate)
+		for(uint8_t i = 0; i < MAX_RIDERS; ++i){
+			if(seg.ride[i] && xy)
+				top = std::min(top, float(riders[i]->topSpeed()) * float(seg.distance) / float(std::abs(seg.ride[i])));
+		}
+		seg.v_top = std::max(1L, long(top));
+		seg.v_max = std::min(seg.v_max, float(seg.v_top) / seg.share);
+		seg.profile.v_entry = seg.profile.v_end = -1L; // not planned yet
+		return seg;
+	}
+	/**
+	 * Fastest speed through the corner between two segments: that of the arc
+	 * tangent to both at the deviation from the corner, with the acceleration
+	 * of the segments (junction deviation). The axes change speed at once in
+	 * the corner, which the default deviation keeps around their start speed
+	 * for square corners.
+	 */
+	float junctionSpeed(const Segment &prev, const Segment &seg) const {
+		float v = std::min(prev.v_max, seg.v_max);
+		if(!deviation || prev.length <= 0.0f)
+			return 0.0f;
+		float c = prev.ux * seg.ux + prev.uy * seg.uy; // cosine of the turn
+		float sinHalf = sqrt(0.5f * (1.0f + c)); // sine of half the corner angle
+		if(sinHalf > 0.9999f)
+			return v; // straight on
+		float r = float(deviation) * sinHalf / (1.0f - sinHalf);
+		return std::min<float>(v, sqrt(std::min(prev.accel, seg.accel) * r));
+	}
+	// entry speeds, backward from a stop at the last target,
+	// then forward from the current speed, each within reach of the other
+	void replan(){
+		float v = 0.0f;
+		for(uint8_t i = numQueued; i-- > 0; ){
+			Segment &seg = queue[(head + i) & (LOOKAHEAD - 1)];
+			seg.v_entry = std::min<float>(seg.v_junction, sqrt(v * v + 2.0f * seg.accel * seg.length));
+			v = seg.v_entry;
+		}
+		const Segment *prev = &current;
+		float left = float(stepsLeftToTarget()) / current.share;
+		v = float(std::abs(stepper(majorAxis)->currentSpeed())) / current.share;
+		for(uint8_t i = 0; i < numQueued; ++i){
+			Segment &seg = queue[(head + i) & (LOOKAHEAD - 1)];
+			seg.v_entry = std::min<float>(seg.v_entry, sqrt(v * v + 2.0f * prev->accel * left));
+			v = seg.v_entry;
+			left = seg.length;
+			prev = &seg;
+		}
+		// speed profiles of the segments whose entry or exit changed
+		for(uint8_t i = 0; i < numQueued; ++i){
+			Segment &seg = queue[(head + i) & (LOOKAHEAD - 1)];
+			float exit = i + 1 < numQueued ? queue[(head + i + 1) & (LOOKAHEAD - 1)].v_entry : 0.0f;
+			long v0 = long(seg.v_entry * seg.share), v1 = long(exit * seg.share);
+			if(v0 != seg.profile.v_entry || v1 != seg.profile.v_end)
+				seg.profile = profileOf(seg.axis, v0, v1, seg.distance, seg.v_top);
+		}
+		planLine();
+	}
+	/**
+	 * Trapezoid of the major axis from v0 to v1 (steps/s) over a distance:
+	 * acceleration up to the fastest speed, cruise, then deceleration, or
+	 * up to the peak where both ramps meet when the distance is too short.
+	 * The ramps are those of the stepper (see Stepper::rampBetweenSpeeds),
+	 * and end at its start speed at least, since slower ones are reached
+	 * directly (the tick halts the line on its last step).
+	 * The speed stays below v_top as well (see segmentTo()).
+	 */
+	Profile profileOf(int axis, long v0, long v1, unsigned long distance, long v_top) const {
+		const Stepper *major = stepper(axis);
+		float a = float(accel);
+		long top = std::min(v_top, major->topSpeed());
+		long start = major->startSpeed();
+		Profile p;
+		p.v_entry = v0;
+		p.v_end = v1;
+		p.v_cruise = top;
+		p.v_exit = std::min(std::max(v1, start), top);
+		Stepper::Ramp up = major->rampBetweenSpeeds(v0, p.v_cruise, a);
+		Stepper::Ramp down = major->rampBetweenSpeeds(p.v_cruise, p.v_exit, a);
+		float cruise = float(distance) - float(std::abs(up.steps) + std::abs(down.steps));
+		if(cruise < 0.0f){
+			// ramps above the start speed only
+			float e0 = float(std::max(v0, start)), e1 = float(p.v_exit);
+			float peak = sqrt(a * float(distance) + 0.5f * (e0 * e0 + e1 * e1));
+			p.v_cruise = std::min(std::max(long(peak), std::max(v0, p.v_exit)), top);
+			up = major->rampBetweenSpeeds(v0, p.v_cruise, a);
+			down = major->rampBetweenSpeeds(p.v_cruise, p.v_exit, a);
+			cruise = std::max<float>(0.0f, float(distance) - float(std::abs(up.steps) + std::abs(down.steps)));
+		}
+		p.brake = std::abs(down.steps);
+		p.time = up.time + down.time + (unsigned long)(cruise * 1e6f / float(p.v_cruise));
+		return p;
+	}
+	// profile of the rest of the current line, from the current speed
+	void planLine(){
+		Stepper *major = stepper(majorAxis);
+		Profile p = profileOf(majorAxis, std::abs(major->currentSpeed()), exitSpeed(), stepsLeftToTarget(), current.v_top);
+		if(!ending && !numQueued)
+			p.brake = 0UL; // transit, no deceleration
+		CriticalSection cs;
+		profile = p;
+		braking = majorLeft != 0UL && majorLeft <= p.brake;
+	}
+	// speed of the major axis at the end of the current segment (steps/s)
+	long exitSpeed() const {
+		if(!numQueued || usesTimers())
+			return Stepper::IDLE_SPEED;
+		return long(queue[head].v_entry * current.share);
+	}
+	// hand the next segment over to the tick, for the junction
+	void prepareNext(){
+		if(!numQueued || usesTimers())
+			return;
+		const Segment &seg = queue[head];
+		Line l = lineOf(seg.target - currTarget, seg.ride);
+		l.profile = seg.profile;
+		CriticalSection cs;
+		if(switches != seenSwitches)
+			return; // already started, see syncSegments()
+		next = l;
+		nextReady = true;
+	}
+	// whether the tick starts the next segment by itself
+	bool isJunctionDue() const {
+		CriticalSection cs;
+		return nextReady && !majorLeft && !hasFollowLeft();
+	}
+	// the segments started by the tick become the current one
+	void syncSegments(){
+		uint8_t n;
+		{
+			CriticalSection cs;
+			n = switches;
+		}
+		while(seenSwitches != n){
+			popSegment();
+			++seenSwitches;
+		}
+	}
+	void popSegment(){
+		lastTarget = currTarget;
+		current = queue[head];
+		currTarget = current.target;
+		head = (head + 1) & (LOOKAHEAD - 1);
+		--numQueued;
+		++targetID;
+		dirty = true;
+	}
+	/**
+	 * The other axes pay what the major axis owes them, in its gear at most
+	 * since they do not go further.
+	 * The advance of the riders is an offset ahead of the line, in the
+	 * direction of the line, which follows the speed of the major axis: its
+	 * changes go to a pool of steps, paid on their own, or by skipping steps
+	 * of the line when it goes back (not while the rider leads the line).
+	 */
+	void followTick(const Stepper *major){
+		long v = -1L; // speed of the major axis (steps/s), when needed
+		for(uint8_t k = 0; k < NUM_AXES; ++k){
+			long *pool = NULL;
+			if(k >= 2){
+				uint8_t i = k - 2;
+				if(rideGain[i] || rideAhead[i]){
+					if(v < 0L)
+						v = std::min(std::abs(major->currentSpeed()), 0xFFFFL);
+					long ahead = axisDir[k] * long((unsigned long)v * rideGain[i] >> 16);
+					ridePool[i] += ahead - rideAhead[i];
+					rideAhead[i] = ahead;
+				}
+				pool = &ridePool[i];
+			}
+			if(!axisLeft[k] && (!pool || !*pool)) continue;
+			if(k == majorAxis && majorLeft) continue; // self-timed
+			Stepper *stp = stepper(k);
+			if(axisLeft[k]){
+				stp->limitGear(axisLeft[k]);
+				stp->shiftTowards(major->currentGear());
+			} else {
+				stp->limitGear(std::abs(*pool));
+			}
+			long s = stp->stepSize();
+			bool owes = owed[k] >= (unsigned long)s;
+			if(owes && pool && *pool * axisDir[k] <= -s){
+				// the advance goes back, the step of the line is skipped
+				owed[k] -= s;
+				axisLeft[k] -= s;
+				*pool += axisDir[k] * s;
+			} else if(owes){
+				stp->pulse(axisDir[k], *major);
+				unsigned long m = stp->pulseSize();
+				owed[k] -= m;
+				axisLeft[k] -= m;
+			} else if(pool && std::abs(*pool) >= s){
+				long dir = sign(*pool);
+				stp->pulse(dir, *major);
+				*pool -= dir * stp->pulseSize();
+			}
+			if(!axisLeft[k] && stp->isFollowing()){
+				stp->unfollow();
+				dirty = true; // the line may be done (see hasReachedTarget())
+			}
+		}
+	}
+	// whether an axis still follows the major one along the current line
+	bool hasFollowLeft() const {
+		for(uint8_t k = 0; k < NUM_AXES; ++k){
+			if(axisLeft[k])
+				return true;
+		}
+		return false;
+	}
+	// whether a rider still has advance to pay or take back
+	bool hasAdvanceLeft() const {
+		for(uint8_t i = 0; i < MAX_RIDERS; ++i){
+			if(ridePool[i] || rideAhead[i])
+				return true;
+		}
+		return false;
+	}
+	void clearQueue(){
+		CriticalSection cs;
+		numQueued = 0;
+		nextReady = false;
+		seenSwitches = switches;
+	}
+
 	Stepper *stepper(int i) const {
 		switch(i){
 			case 0: return stpX;
 			case 1: return stpY;
+			case 2:
+			case 3:
+				if(riders[i - 2])
+					return riders[i - 2];
+				// fall through
 			default:
 				error = ERR_INVALID_ACCESSOR;
 				return stpY;
@@ -349,11 +909,32 @@ protected:
 public:
   void debug() {
     Serial.println("debug(m):");
-    Serial.print("f_best "); Serial.println(f_best, DEC);
-    Serial.print("df_max "); Serial.println(df_max, DEC);
+    Serial.print("v_best "); Serial.println(v_best, DEC);
+    Serial.print("accel  "); Serial.println(accel, DEC);
+    Serial.print("jerk   "); Serial.println(jerk, DEC);
     Serial.print("eps    "); Serial.println(epsilon, DEC);
     Serial.print("lastTg "); Serial.print(lastTarget.x, DEC); Serial.print(", "); Serial.println(lastTarget.y, DEC);
     Serial.print("currTg "); Serial.print(currTarget.x, DEC); Serial.print(", "); Serial.println(currTarget.y, DEC);
+    Serial.print("line   "); Serial.print(majorAxis, DEC); Serial.print(", ");
+      Serial.print(majorTotal, DEC); Serial.print(", left "); Serial.println(stepsLeftToTarget(), DEC);
+    for(uint8_t k = 0; k < 2; ++k){
+      if(k == majorAxis) continue;
+      Serial.print("follow "); Serial.print(k, DEC); Serial.print(", ");
+        Serial.print(axisTotal[k], DEC); Serial.print(", left "); Serial.println(axisLeft[k], DEC);
+    }
+    for(uint8_t i = 0; i < MAX_RIDERS; ++i){
+      if(!riders[i]) continue;
+      Serial.print("ride   "); Serial.print(i, DEC); Serial.print(", ");
+        Serial.print(axisTotal[2 + i], DEC); Serial.print(", left "); Serial.print(axisLeft[2 + i], DEC);
+        Serial.print(", advance "); Serial.print(rideK[i], DEC); Serial.print(" ms, ahead ");
+        Serial.print(rideAhead[i], DEC); Serial.print(" (pool "); Serial.print(ridePool[i], DEC); Serial.println(")");
+    }
+    Serial.print("queue  "); Serial.print(numQueued, DEC); Serial.print("/"); Serial.print(LOOKAHEAD, DEC);
+      Serial.print(", dev "); Serial.print(deviation, DEC);
+      Serial.print(", exit "); Serial.println(exitSpeed(), DEC);
+    Serial.print("prof   "); Serial.print(profile.v_cruise, DEC); Serial.print(" > "); Serial.print(profile.v_exit, DEC);
+      Serial.print(" from "); Serial.print(profile.brake, DEC); Serial.print(braking ? " (braking)" : "");
+      Serial.print(", time "); Serial.print(plannedTime(), DEC); Serial.println(" us");
   }
 
   void setDebugMode(int m){
@@ -362,17 +943,49 @@ public:
 
 private:
 	Stepper *stpX, *stpY;
-	unsigned long f_best, df_max;
+	unsigned long v_best, accel; // steps/s, steps/s²
+	unsigned long jerk;          // steps/s³
 	unsigned long epsilon, epsilonSq;
+	unsigned long deviation; // junction deviation (1/16 microsteps)
 	
 	// xy target data
 	vec2 lastTarget;
 	vec2 currTarget;
 	bool ending;
 	unsigned long targetID;
+	volatile bool dirty; // to recompute in update() (also set by the tick)
+
+	// line interpolation (shared with the tick)
+	int majorAxis;            // the longest axis, self-timed (see stepper())
+	long majorDir;
+	unsigned long majorTotal; // 1/16 microsteps
+	unsigned long majorLeft;  // remaining distance
+	Stepper *riders[MAX_RIDERS];
+	// the other axes, following the major one (none at majorAxis)
+	long axisDir[NUM_AXES];
+	unsigned long axisTotal[NUM_AXES], axisLeft[NUM_AXES];
+	unsigned long residual[NUM_AXES]; // Bresenham accumulators
+	unsigned long owed[NUM_AXES];     // distances owed by the major axis
+	unsigned long rideK[MAX_RIDERS];    // pressure advance (ms, see setAdvance())
+	unsigned long rideGain[MAX_RIDERS]; // advance per speed of the major axis
+	long rideAhead[MAX_RIDERS];         // advance at the current speed (signed)
+	long ridePool[MAX_RIDERS];          // advance left to step (signed)
+	Profile profile;          // speeds of the major axis
+	volatile bool braking;
+
+	// lookahead (main loop)
+	Segment current;
+	Segment queue[LOOKAHEAD];
+	uint8_t head, numQueued;
+	uint8_t seenSwitches;
+	// junction (shared with the tick)
+	Line next;
+	volatile bool nextReady;
+	volatile uint8_t switches; // segments started by the tick
 	
-	// callback
+	// callbacks
 	Callback callback;
+	Callback feeder;
 	int state;
 
   // state
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "Arduino.h"
+#include "error.h"
+
+/**
+ * Output pins with direct port I/O.
+ *
+ * On the Mega, the port register and bit mask of a pin are resolved
+ * through constexpr pin traits (ATmega2560 layout), so that a write is
+ * a single read-modify-write of the port register instead of a
+ * digitalWrite() call (which looks up PROGMEM tables and checks timers).
+ * Other targets (and the host build) fall back to digitalWrite().
+ *
+ * /!\ writes are not atomic: outside of the step interrupt,
+ *     callers must hold a CriticalSection
+ */
+#if defined(__AVR_ATmega2560__) || defined(__AVR_ATmega1280__)
+#define PINS_DIRECT_IO
+#endif
+
+namespace pins {
+
+#ifdef PINS_DIRECT_IO
+  // data space address of the PORTx registers
+  constexpr uint16_t PORT_ADDRESS[] = {
+    0x22,  // PORTA
+    0x25,  // PORTB
+    0x28,  // PORTC
+    0x2B,  // PORTD
+    0x2E,  // PORTE
+    0x31,  // PORTF
+    0x34,  // PORTG
+    0x102, // PORTH
+    0x105, // PORTJ
+    0x108, // PORTK
+    0x10B  // PORTL
+  };
+  enum PortIndex { PA = 0, PB, PC, PD, PE, PF, PG, PH, PJ, PK, PL };
+
+  // port index (high nibble) and bit (low nibble) of each digital pin
+  #define PIN_TRAIT(p, b) ((p) << 4 | (b))
+  constexpr uint8_t PIN_TRAITS[] = {
+    PIN_TRAIT(PE, 0), PIN_TRAIT(PE, 1), PIN_TRAIT(PE, 4), PIN_TRAIT(PE, 5), // 0-3
+    PIN_TRAIT(PG, 5), PIN_TRAIT(PE, 3), PIN_TRAIT(PH, 3), PIN_TRAIT(PH, 4), // 4-7
+    PIN_TRAIT(PH, 5), PIN_TRAIT(PH, 6), PIN_TRAIT(PB, 4), PIN_TRAIT(PB, 5), // 8-11
+    PIN_TRAIT(PB, 6), PIN_TRAIT(PB, 7), PIN_TRAIT(PJ, 1), PIN_TRAIT(PJ, 0), // 12-15
+    PIN_TRAIT(PH, 1), PIN_TRAIT(PH, 0), PIN_TRAIT(PD, 3), PIN_TRAIT(PD, 2), // 16-19
+    PIN_TRAIT(PD, 1), PIN_TRAIT(PD, 0), PIN_TRAIT(PA, 0), PIN_TRAIT(PA, 1), // 20-23
+    PIN_TRAIT(PA, 2), PIN_TRAIT(PA, 3), PIN_TRAIT(PA, 4), PIN_TRAIT(PA, 5), // 24-27
+    PIN_TRAIT(PA, 6), PIN_TRAIT(PA, 7), PIN_TRAIT(PC, 7), PIN_TRAIT(PC, 6), // 28-31
+    PIN_TRAIT(PC, 5), PIN_TRAIT(PC, 4), PIN_TRAIT(PC, 3), PIN_TRAIT(PC, 2), // 32-35
+    PIN_TRAIT(PC, 1), PIN_TRAIT(PC, 0), PIN_TRAIT(PD, 7), PIN_TRAIT(PG, 2), // 36-39
+    PIN_TRAIT(PG, 1), PIN_TRAIT(PG, 0), PIN_TRAIT(PL, 7), PIN_TRAIT(PL, 6), // 40-43
+    PIN_TRAIT(PL, 5), PIN_TRAIT(PL, 4), PIN_TRAIT(PL, 3), PIN_TRAIT(PL, 2), // 44-47
+    PIN_TRAIT(PL, 1), PIN_TRAIT(PL, 0), PIN_TRAIT(PB, 3), PIN_TRAIT(PB, 2), // 48-51
+    PIN_TRAIT(PB, 1), PIN_TRAIT(PB, 0),                                     // 52-53
+    PIN_TRAIT(PF, 0), PIN_TRAIT(PF, 1), PIN_TRAIT(PF, 2), PIN_TRAIT(PF, 3), // A0-A3
+    PIN_TRAIT(PF, 4), PIN_TRAIT(PF, 5), PIN_TRAIT(PF, 6), PIN_TRAIT(PF, 7), // A4-A7
+    PIN_TRAIT(PK, 0), PIN_TRAIT(PK, 1), PIN_TRAIT(PK, 2), PIN_TRAIT(PK, 3), // A8-A11
+    PIN_TRAIT(PK, 4), PIN_TRAIT(PK, 5), PIN_TRAIT(PK, 6), PIN_TRAIT(PK, 7)  // A12-A15
+  };
+  #undef PIN_TRAIT
+  static const uint8_t NUM_PINS = sizeof(PIN_TRAITS);
+
+  // pins past the table write no bit of GPIOR0, a register free for the
+  // sketch, instead of some address out of the table (see Pin::output())
+  static const uint16_t NO_ADDRESS = 0x3E;
+
+  constexpr bool isValid(uint8_t pin) {
+    return pin < NUM_PINS;
+  }
+  constexpr uint16_t address(uint8_t pin) {
+    return isValid(pin) ? PORT_ADDRESS[PIN_TRAITS[pin] >> 4] : NO_ADDRESS;
+  }
+  constexpr uint8_t mask(uint8_t pin) {
+    return isValid(pin) ? 1 << (PIN_TRAITS[pin] & 0x0F) : 0;
+  }
+#else
+  constexpr bool isValid(uint8_t pin) {
+    return true; // see digitalWrite()
+  }
+  constexpr uint16_t address(uint8_t pin) {
+    return 0;
+  }
+  constexpr uint8_t mask(uint8_t pin) {
+    return 1; // one pin per "port"
+  }
+#endif
+
+}
+
+class Pin {
+public:
+
+  constexpr Pin(uint8_t p = 0) : id(p), addr(pins::address(p)), bit(pins::mask(p)) {}
+
+  void output() const {
+    if(!pins::isValid(id)){
+      error = ERR_INVALID_PIN;
+      return;
+    }
+    pinMode(id, OUTPUT);
+  }
+
+#ifdef PINS_DIRECT_IO
+  void high() const {
+    *port() |= bit;
+  }
+  void low() const {
+    *port() &= ~bit;
+  }
+  // write several pins of this port at once
+  void setBits(uint8_t m) const {
+    *port() |= m;
+  }
+  void clearBits(uint8_t m) const {
+    *port() &= ~m;
+  }
+  bool sharesPort(const Pin &p) const {
+    return addr == p.addr;
+  }
+#else
+  void high() const {
+    digitalWrite(id, HIGH);
+  }
+  void low() const {
+    digitalWrite(id, LOW);
+  }
+  void setBits(uint8_t m) const {
+    if(m) high();
+  }
+  void clearBits(uint8_t m) const {
+    if(m) low();
+  }
+  bool sharesPort(const Pin &p) const {
+    return id == p.id;
+  }
+#endif
+
+  void write(int v) const {
+    if(v == LOW)
+      low();
+    else
+      high();
+  }
+
+  // --- getters ---------------------------------------------------------------
+  uint8_t number() const {
+    return id;
+  }
+  volatile uint8_t *port() const {
+    return (volatile uint8_t *)addr;
+  }
+  uint8_t mask() const {
+    return bit;
+  }
+
+private:
+  uint8_t id;
+  uint16_t addr;
+  uint8_t bit;
+};
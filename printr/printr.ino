@@ -8,11 +8,10 @@
 #include "locator.h"
 #include "elevator.h"
 #include "gcode.h"
+#include "ticker.h"
+#include "events.h"
+#include "bench.h"
 
-// delays in milliseconds
-#define delayFunc delayMicroseconds
-#define DELAY_INTER 100
-#define DELAY_AFTER 100
 #define TENTH_MILLISECOND 1L
 #define HALF_MILLISECOND  (5L * TENTH_MILLISECOND)
 #define MILLISECOND       (2L * HALF_MILLISECOND)
@@ -49,6 +48,9 @@ void setup();
 void loop();
 void react();
 void process();
+void stepRise();
+void stepFall();
+void planTick();
 bool idle();
 Stepper *selectStepper(char c);
 void readCommands(Stream& input = Serial);
@@ -76,9 +78,29 @@ void setup() {
   stpY.setRange(13693UL);
   stpZ.setRange(122100UL); // to be set at print time to be close to plate
 
+  // automatic microstep shifts (coarser modes shake everything, see speeds.h)
+  stpX.setGearing(Stepper::MS_1_4);
+  stpY.setGearing(Stepper::MS_1_4);
+  stpZ.setGearing(Stepper::MS_1_2);
+
+  // step timers (see hwstep.h), used with "s x hw 1" or "s m hw 1"
+  stpX.setTimer(hwstep::TIMER1);
+  stpE0.setTimer(hwstep::TIMER3); // OC3B
+  stpY.setTimer(hwstep::TIMER4);  // OC4C
+  stpZ.setTimer(hwstep::TIMER5);
+
+  // z and e ride along the xy lines of the gcode moves (see Locator::setRider)
+  locXY.setRider(gcode::Z_RIDER, &stpZ);
+  locXY.setRider(gcode::E_RIDER, &stpE0);
+  locZ.setCarrier(&locXY, gcode::Z_RIDER);
+
   // global callbacks
   idleCallback = errorCallback = NULL;
   // switchCallback = resetToHome;
+
+  // start the step clock (ticks planned ahead with "s q 1", see events.h)
+  events::begin(planTick);
+  ticker::begin(stepRise, stepFall);
 }
 
 ////////////////////////////////////////////////////////////////
@@ -107,26 +129,42 @@ void react() {
     int s = analogRead(i);
     if(s > switchThreshold){
       lastSwitchCheck[i - SWITCH_FIRST] = thisTime; // remember time so we don't check too soon again
+      Stepper *stp;
+      bool isMax = false;
       switch(i){
         case SWITCH_X_MIN:
-          stpX.setMinValue(stpX.value());
+          stp = &stpX;
           break;
         case SWITCH_X_MAX:
-          stpX.setMaxValue(stpX.value());
+          stp = &stpX;
+          isMax = true;
           break;
         case SWITCH_Y_MIN:
-          stpY.setMinValue(stpY.value());
+          stp = &stpY;
           break;
         case SWITCH_Y_MAX:
-          stpY.setMaxValue(stpY.value());
+          stp = &stpY;
+          isMax = true;
           break;
         case SWITCH_Z_MIN:
-          stpZ.setMinValue(stpZ.value());
+          stp = &stpZ;
           break;
         default:
           Serial.println("AnalogRead: invalid entry!");
           continue;
       }
+      // the bound is where the motor is, the queued steps past it are dropped
+      // first (see events::clear()) so that the planner is back there too
+      long bound = stp->motorValue();
+      if(isMax ? stp->value() > bound : stp->value() < bound)
+        events::clear();
+      if(isMax)
+        stp->setMaxValue(bound);
+      else
+        stp->setMinValue(bound);
+      // emergency cutoff towards the new bound
+      if(stp->guardBounds())
+        events::clear();
       if(switchCallback){
         switchCallback(i);
       }
@@ -141,19 +179,41 @@ void react() {
 ///// Process events ///////////////////////////////////////////
 ////////////////////////////////////////////////////////////////
 void process() {
-  // update location
+  // update location (the steps are generated by the ticker)
   locXY.update();
   locZ.update();
-  
-  // update steppers
+  // soft limits of the speed moves, then period updates of the step timers
   for(int i = 0; i < NUM_STEPPERS; ++i){
-    steppers[i]->exec();
+    steppers[i]->guardBounds();
+    steppers[i]->updateTimer();
   }
-  delayFunc(DELAY_INTER);
-  for(int i = 0; i < NUM_STEPPERS; ++i){
-    steppers[i]->release();
+  // next ticks of the step queue
+  events::fill();
+}
+
+////////////////////////////////////////////////////////////////
+///// Step tick (timer interrupt) //////////////////////////////
+////////////////////////////////////////////////////////////////
+void stepRise() {
+  if(events::isActive()){
+    events::pop(); // planned by planTick()
+    return;
   }
-  delayFunc(DELAY_AFTER);
+  // all the axes in one pass (see axes.h)
+  Stepper::execAll();
+  // line interpolation of the followers
+  locXY.tick();
+  // all rising edges at once
+  pulses::markAxes(axes::pulsing);
+  pulses::rise();
+}
+void stepFall() {
+  pulses::fall();
+}
+// same tick, ahead of time in the main loop (see events.h)
+void planTick() {
+  Stepper::execAll();
+  locXY.tick();
 }
 
 ////////////////////////////////////////////////////////////////
@@ -163,13 +223,15 @@ bool idle() {
   for(int i = 0; i < NUM_STEPPERS; ++i){
     if(steppers[i]->isRunning()) return false;
   }
-  return true;
+  // a line that just ended, before its callback or next target
+  return !locXY.isEnabled() || !locXY.hasTarget();
 }
 
 ////////////////////////////////////////////////////////////////
 ///// Reset states and errors //////////////////////////////////
 ////////////////////////////////////////////////////////////////
 void resetAll(int state = 0){
+  events::clear();
   for(int i = 0; i < NUM_STEPPERS; ++i)
     steppers[i]->reset();
   locXY.reset();
@@ -319,6 +381,19 @@ void readCommands(Stream& input){
             locZ.debug();
             break;
 
+          case 'Q':
+          case 'q':
+            events::debug();
+            break;
+
+          case 'T':
+          case 't':
+            timing::debug();
+            for(int i = 0; i < NUM_STEPPERS; ++i)
+              steppers[i]->debugTiming();
+            timing::clear(); // statistics since the last dump
+            break;
+
           default:
             Serial.print("Cannot debug '");
             Serial.print(c);
@@ -327,6 +402,45 @@ void readCommands(Stream& input){
         }
       } break;
 
+      // --- benchmarks
+      case 'B':
+      case 'b': {
+        char c = command.readFullChar();
+        // the benchmarks pause the tick and run axes of their own
+        if(!idle() || locZ.hasTarget() || !events::isEmpty()){
+          Serial.println("Cannot benchmark while moving");
+          break;
+        }
+        switch(c){
+          case 'P':
+          case 'p':
+            bench::pins();
+            break;
+
+          case 'F':
+          case 'f': {
+            unsigned long v_start = command.readULong();
+            bench::estimators(v_start ? v_start : 1000UL);
+          } break;
+
+          case 'M':
+          case 'm':
+            bench::locator();
+            break;
+
+          case 'Q':
+          case 'q':
+            bench::queue();
+            break;
+
+          default:
+            Serial.print("Cannot benchmark '");
+            Serial.print(c);
+            Serial.println("'");
+            break;
+        }
+      } break;
+
       // --- microstepping pin mode
       case 'U':
       case 'u': {
@@ -381,7 +495,7 @@ void readCommands(Stream& input){
         locZ.setTarget(z);
       } return; // release input reading
       
-      // --- extrude period
+      // --- move at speed (steps/s)
       case 'X':
       case 'x':
       case 'Y':
@@ -391,9 +505,9 @@ void readCommands(Stream& input){
       case 'E':
       case 'e': {
         Stepper *stp = selectStepper(type);
-        long freq = command.readLong();
-        Serial.print(type); Serial.print(" "); Serial.println(freq, DEC);
-        stp->moveToFreq(freq);
+        long speed = command.readLong();
+        Serial.print(type); Serial.print(" "); Serial.println(speed, DEC);
+        stp->moveToSpeed(speed);
       } break;
 
       // --- set pin code value
@@ -419,7 +533,7 @@ void readCommands(Stream& input){
                 stp->setDebugMode(command.readInt());
               }else if(c2 == 'f'){
                 command.readChar(); // consume it
-                stp->setDeltaFreq(command.readULong());
+                stp->setAcceleration(command.readULong());
               } else {
                 error = ERR_INVALID_SETTINGS;
                 return;
@@ -434,7 +548,26 @@ void readCommands(Stream& input){
             } else {
               char c2 = command.readChar();
               if(c1 == 'f' && c2 == 's'){
-                stp->setSafeFreq(command.readULong());
+                stp->setStartSpeed(command.readULong());
+              } else if(c1 == 'l' && c2 == 'a'){
+                locXY.setAdvance(stp, command.readULong());
+              } else if(c1 == 'f' && c2 == 'l'){
+                gcode::Eflow = command.readLong();
+                Serial.print("Extrusion flow set to ");
+                Serial.println(gcode::Eflow, DEC);
+              } else if(c1 == 'g' && c2 == 'r'){
+                byte mode = Stepper::modeForSteps(16L / std::max(1L, command.readLong()));
+                if(error == ERR_NONE){
+                  stp->setGearing(mode);
+                }
+              } else if(c1 == 'j' && c2 == 'k'){
+                stp->setJerk(command.readULong());
+              } else if(c1 == 'h' && c2 == 'w'){
+                stp->useTimer(command.readInt() != 0);
+                Serial.print("Timer steps of ");
+                Serial.print(c);
+                Serial.print(": ");
+                Serial.println(stp->usesTimer() ? 1 : 0, DEC);
               } else if(c1 == 'r' && c2 == 'g'){
                 unsigned long range = command.readULong();
                 if(range){
@@ -461,7 +594,7 @@ void readCommands(Stream& input){
                 locXY.setDebugMode(command.readInt());
               } else if(c2 == 'f') {
                 c2 = command.readChar(); // consume it
-                locXY.setMaxDeltaFreq(command.readULong());
+                locXY.setAcceleration(command.readULong());
               } else {
                 error = ERR_INVALID_SETTINGS;
                 return;
@@ -469,7 +602,15 @@ void readCommands(Stream& input){
             } else {
               char c2 = command.readChar();
               if(c1 == 'f' && c2 == 'b'){
-                locXY.setBestFreq(command.readULong());
+                locXY.setBestSpeed(command.readULong());
+              } else if(c1 == 'j' && c2 == 'd'){
+                locXY.setDeviation(command.readULong());
+              } else if(c1 == 'j' && c2 == 'k'){
+                locXY.setJerk(command.readULong());
+              } else if(c1 == 'h' && c2 == 'w'){
+                locXY.useTimers(command.readInt() != 0);
+                Serial.print("Timer steps of xy: ");
+                Serial.println(locXY.usesTimers() ? 1 : 0, DEC);
               } else {
                 char c3 = command.readChar();
                 if(c1 == 'e' && c2 == 'p' && c3 == 's'){
@@ -492,7 +633,7 @@ void readCommands(Stream& input){
                 locZ.setDebugMode(command.readInt());
               } else if(c2 == 'f'){
                 c2 = command.readChar(); // consume it
-                locZ.setMaxDeltaFreq(command.readULong());
+                locZ.setAcceleration(command.readULong());
               } else {
                 error = ERR_INVALID_SETTINGS;
                 return;
@@ -500,7 +641,9 @@ void readCommands(Stream& input){
             } else {
               char c2 = command.readChar();
               if(c1 == 'f' && c2 == 'b'){
-                locZ.setBestFreq(command.readULong());
+                locZ.setBestSpeed(command.readULong());
+              } else if(c1 == 'j' && c2 == 'k'){
+                locZ.setJerk(command.readULong());
               } else {
                 error = ERR_INVALID_SETTINGS;
                 return;
@@ -523,12 +666,22 @@ void readCommands(Stream& input){
             }
           } break;
 
+          // - step queue
+          case 'Q':
+          case 'q':
+            events::setActive(command.readInt() != 0);
+            Serial.print("Step queue: ");
+            Serial.println(events::isActive() ? 1 : 0, DEC);
+            break;
+
           // - gcode settings
           case 'G':
           case 'g': {
             char c1 = command.readFullChar();
             if(c1 == 'd' || c1 == 'D'){
               gcode::debug = !!command.readInt();
+            } else if(c1 == 'a' || c1 == 'A'){
+              gcode::arcTolerance = std::max(1L, command.readLong());
             } else {
               error = ERR_INVALID_SETTINGS;
             }
@@ -677,6 +830,7 @@ void loop() {
     process();
   } else if(error > ERR_NONE){
     // reset all the motors because of error
+    events::clear();
     for(int i = 0; i < NUM_STEPPERS; ++i){
       steppers[i]->reset();
     }
@@ -725,18 +879,24 @@ void processFileError(int error){
 }
 
 void processNextLine(int state = 0){
+  if(state == 1 && gcodeReader.isWaiting())
+    return; // see gcode::CommandReader::isSynchronized()
   File &file = sdcard::currentFile();
-  Serial.print("Next line of ");
-  Serial.println(file.name());
-  Serial.println(file.available(), DEC);
+  if(gcode::debug){
+    // on every call of the feeder (s g d 1)
+    Serial.print("Next line of ");
+    Serial.println(file.name());
+    Serial.println(file.available(), DEC);
+  }
   if(!file){
     error = ERR_FILE_UNAVAILABLE;
     return;
-  } else if(!file.available()){
+  } else if(!file.available() && !(state == 1 && gcodeReader.isPending())){
     Serial.print("EOF: ");
     Serial.println(file.name());
     file.close();
     locXY.setCallback(NULL);
+    locXY.setFeeder(NULL);
     locZ.setCallback(NULL);
     return;
   }
@@ -764,7 +924,12 @@ void processFile(File &file, bool gcode, float scale){
   // process file lines one by one
   // => set callbacks and states
   errorCallback = processFileError;
-  locXY.setCallback(processNextLine); locXY.setState(gcode ? 1 : 0);
+  // gcode lines fill the lookahead, other commands wait for their target
+  if(gcode)
+    locXY.setFeeder(processNextLine);
+  else
+    locXY.setCallback(processNextLine);
+  locXY.setState(gcode ? 1 : 0);
   // locZ.setCallback(processNextLine); locZ.setState(gcode ? 1 : 0);
   // initialize potential gcode reader
   if(gcode){
@@ -822,7 +987,6 @@ void boundaryEvent(int which){
     vec2 homeLoc(stpX.minValue() + stpX.range() / 2L, stpY.minValue() + stpY.range() / 2L);
     locXY.enable(); locXY.setState(1 << 0);  locXY.setTarget(homeLoc);
     locZ.enable();  locZ.setState(1 << 1);   locZ.setTarget(stpZ.maxValue());
-    stpZ.microstep(Stepper::MS_1_2); // to go at max frequency using H
     // set callbacks
     locXY.setCallback(homeCheckEvent);
     locZ.setCallback(homeCheckEvent);
@@ -833,8 +997,8 @@ void boundaryEvent(int which){
     Serial.println("shifting");
     homeStatus |= 1 << 3; // mask for this specific event
     // change direction
-    stpX.moveToFreq(-3L);
-    stpY.moveToFreq(-3L);
+    stpX.moveToSpeed(-1666L);
+    stpY.moveToSpeed(-1666L);
     // shift to avoid switch events
     vec2 shift(stpX.maxValue() - 100L, stpY.maxValue() - 100L);
     locXY.enable();
@@ -864,10 +1028,9 @@ void calibrateHome(Callback cb, int switchEvent){
     locXY.disable();
     locZ.disable();
     // go to switches in both X and Y
-    stpX.moveToFreq(1L);
-    stpY.moveToFreq(2L);
-    stpZ.microstep(Stepper::MS_1_2);
-    stpZ.moveToFreq(-2L);
+    stpX.moveToSpeed(5000L); // steps/s
+    stpY.moveToSpeed(2500L);
+    stpZ.moveToSpeed(-20000L); // through gears up to 1/2
   }
 }
 
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Arduino.h"
+#include "error.h"
+#include "pins.h"
+#include "axes.h"
+
+/**
+ * Step output stage.
+ *
+ * The tick collects the axes that pulse (axes::pulsing, or an event of
+ * the step queue, see events.h), and the stage then writes each port once
+ * for the rising edges and once for the falling edges. Pulses of axes
+ * sharing a port (e.g. X and Z on PORTA) are therefore truly simultaneous.
+ */
+namespace pulses {
+
+  static const uint8_t MAX_PORTS = 8;
+
+  // state
+  Pin ports[MAX_PORTS];     // one pin for each used port
+  uint8_t masks[MAX_PORTS]; // pulses of the current tick
+  uint8_t numPorts = 0;
+
+  /**
+   * Register a step pin and return the slot of its port
+   */
+  uint8_t attach(const Pin &pin) {
+    for(uint8_t i = 0; i < numPorts; ++i){
+      if(ports[i].sharesPort(pin))
+        return i;
+    }
+    if(numPorts == MAX_PORTS){
+      error = ERR_INVALID_ACCESSOR;
+      return 0;
+    }
+    ports[numPorts] = pin;
+    masks[numPorts] = 0;
+    return numPorts++;
+  }
+
+  inline void mark(uint8_t slot, uint8_t mask) {
+    masks[slot] |= mask;
+  }
+  // pulses of the axes in m (bit i = axis i, see axes.h)
+  inline void markAxes(uint8_t m) {
+    for(uint8_t i = 0; m; ++i, m >>= 1){
+      if(m & 1)
+        mark(axes::slot[i], axes::mask[i]);
+    }
+  }
+
+  // rising edges
+  void rise() {
+    for(uint8_t i = 0; i < numPorts; ++i){
+      if(masks[i])
+        ports[i].setBits(masks[i]);
+    }
+  }
+
+  // falling edges
+  void fall() {
+    for(uint8_t i = 0; i < numPorts; ++i){
+      if(masks[i]){
+        ports[i].clearBits(masks[i]);
+        masks[i] = 0;
+      }
+    }
+  }
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Arduino.h"
+
+/**
+ * Speed profiles of each axis for each microstep mode, as measured on the
+ * machine: the periods that run correctly, from the fastest one up. This
+ * table is the only record of the measurements (it replaces speeds.dat),
+ * so new ones go here, with their notes.
+ *
+ * Periods are in ticks (converted to steps/s through ticker::rateOfPeriod):
+ * - fastest: shortest period that runs correctly
+ * - start:   period that can be reached directly (from idle or a reversal),
+ *            faster periods are reached through the acceleration ramp
+ *
+ * SPEED(axis, microsteps, fastest, start)
+ */
+#define SPEED_TABLE(SPEED) \
+  SPEED('x', 16, 1, 5) /* 1..5 (maybe larger) */ \
+  SPEED('y', 16, 1, 5) \
+  SPEED('x',  8, 1, 3) /* 1,2,3 */ \
+  SPEED('y',  8, 1, 3) \
+  SPEED('x',  4, 1, 3) /* 1,2,3 */ \
+  SPEED('y',  4, 1, 3) \
+  SPEED('x',  2, 1, 3) /* 1,2,3 but shakes everything, and the switches */ \
+  SPEED('y',  2, 1, 3) /* do not react fast enough (same in full steps) */ \
+  SPEED('x',  1, 1, 3) \
+  SPEED('y',  1, 1, 3) \
+  SPEED('z',  1, 2, 2) /* 2 */ \
+  SPEED('z',  2, 1, 2) /* 1,2 */ \
+  SPEED('z',  4, 1, 1) /* all */ \
+  SPEED('z',  8, 1, 1) \
+  SPEED('z', 16, 1, 1)
+
+namespace speeds {
+
+  struct Profile {
+    char axis;
+    uint8_t microsteps;
+    uint8_t fastest;
+    uint8_t start;
+  };
+
+  // profile of axes / modes that are not in the table
+  static const uint8_t DEFAULT_FASTEST = 1;
+  static const uint8_t DEFAULT_START   = 5;
+
+  #define SPEED_PROFILE(a, ms, f, s) { a, ms, f, s },
+  constexpr Profile PROFILES[] PROGMEM = {
+    SPEED_TABLE(SPEED_PROFILE)
+  };
+  #undef SPEED_PROFILE
+  static const uint8_t NUM_PROFILES = sizeof(PROFILES) / sizeof(Profile);
+
+  // --- compile-time checks of the table --------------------------------------
+  constexpr bool isValidMode(uint8_t ms) {
+    return ms == 1 || ms == 2 || ms == 4 || ms == 8 || ms == 16;
+  }
+  constexpr bool isValid(const Profile &p) {
+    return isValidMode(p.microsteps) && p.fastest > 0 && p.fastest <= p.start;
+  }
+  constexpr bool isUnique(uint8_t i, uint8_t j = 0) {
+    return j >= i || ((PROFILES[j].axis != PROFILES[i].axis
+                    || PROFILES[j].microsteps != PROFILES[i].microsteps) && isUnique(i, j + 1));
+  }
+  constexpr bool isValidTable(uint8_t i = 0) {
+    return i >= NUM_PROFILES || (isValid(PROFILES[i]) && isUnique(i) && isValidTable(i + 1));
+  }
+  static_assert(isValidTable(), "invalid speed table (see speeds.h)");
+
+  /**
+   * Profile of an axis for a given number of microsteps per full step
+   */
+  Profile lookup(char axis, uint8_t microsteps) {
+    for(uint8_t i = 0; i < NUM_PROFILES; ++i){
+      Profile p;
+      memcpy_P(&p, &PROFILES[i], sizeof(Profile));
+      if(p.axis == axis && p.microsteps == microsteps)
+        return p;
+    }
+    Profile p = { axis, microsteps, DEFAULT_FASTEST, DEFAULT_START };
+    return p;
+  }
+
+}
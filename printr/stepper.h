@@ -2,6 +2,14 @@
 
 #include "Arduino.h"
 #include "utils.h"
+#include "pins.h"
+#include "pulses.h"
+#include "speeds.h"
+#include "ticker.h"
+#include "hwstep.h"
+#include "axes.h"
+#include "events.h"
+#include "timing.h"
 
 #define MAX_LONG 2147483647L
 #define MIN_LONG -2147483648L
@@ -51,259 +59,689 @@ public:
     }
   }
   
-  // exceptional idle frequency case
-  static const long IDLE_FREQ = 0L;
+  // gears: microstep modes from 1/16 (gear 0, step of 1) to full steps (gear 4, step of 16)
+  static const uint8_t NUM_GEARS = 5;
+  static const unsigned long NO_LIMIT = 0xFFFFFFFFUL;
+  // axis without step timer (see hwstep.h)
+  static const uint8_t NO_TIMER = 0xFF;
+
+  // exceptional idle speed case
+  static const long IDLE_SPEED = 0L;
+  // default acceleration (steps/s²)
+  static const unsigned long DEFAULT_ACCEL = 100000UL;
 
   Stepper(int s, int d, int m1, int m2, int m3, int e, char id = '?', int o = LOW)
-    : stp(s), dir(d), ms1(m1), ms2(m2), ms3(m3), en(e), ident(id),
+    : ax(axes::attach(this)),
+      stp(s), dir(d), ms1(m1), ms2(m2), ms3(m3), en(e), ident(id),
       posDirSignal(o == LOW ? LOW : HIGH), negDirSignal(o == LOW ? HIGH : LOW) {
-      enabled = false;
-      // freq data
-      count = 0L;
-      f_cur = f_mem = 0L;
-      f_trg = 0L;
-      df = 1L;
-      f_safe = 5L;
+      axes::slot[ax] = axes::mask[ax] = 0; // no output before setup()
+      enabled() = false;
+      following() = false;
+      pulsed() = 0L;
+      hardware() = false;
+      timer = NO_TIMER;
+      debugMode = 0;
+      gear() = topGear() = 0;
+      gearLimit = NO_LIMIT;
+      stopPos = brakeLeft = 0L;
+      stopDir = 1;
+      // speed data
+      phase() = 0L;
+      v_cur() = v_trg() = 0L;
+      da() = a_cur() = v_fade() = 0L;
+      setAcceleration(DEFAULT_ACCEL);
+      for(uint8_t g = 0; g < NUM_GEARS; ++g){
+        speeds::Profile p = { id, uint8_t(16 >> g), speeds::DEFAULT_FASTEST, speeds::DEFAULT_START };
+        setSpeedProfile(p);
+      }
       // positioning
-      steps = 0L;
+      steps() = 0L;
       stepMode = MS_SLOW;
-      stepDelta = stepsForMode(stepMode);
-      stepDir = posDirSignal;
+      stepDir() = 1;
       // boundaries
-      maxSteps = MAX_LONG;
-      minSteps = MIN_LONG;
+      maxSteps() = MAX_LONG;
+      minSteps() = MIN_LONG;
       stepRange = 0L;
   }
+  ~Stepper() {
+    axes::detach(ax);
+  }
   void setup() {
-    pinMode(stp, OUTPUT);
-    pinMode(dir, OUTPUT);
-    pinMode(ms1, OUTPUT);
-    pinMode(ms2, OUTPUT);
-    pinMode(ms3, OUTPUT);
-    pinMode(en, OUTPUT);
+    stp.output();
+    dir.output();
+    ms1.output();
+    ms2.output();
+    ms3.output();
+    en.output();
+    axes::slot[ax] = pulses::attach(stp);
+    axes::mask[ax] = stp.mask();
+    for(uint8_t g = 0; g < NUM_GEARS; ++g){
+      setSpeedProfile(speeds::lookup(ident, 16 >> g));
+    }
     reset();
   }
 
   void reset() {
+    if(hardware()) finishTimer();
+    CriticalSection cs;
     enable();
-    df = 1L;
-    f_safe = 5L;
-    count = f_cur = f_trg = f_mem = 0L;
+    setAcceleration(DEFAULT_ACCEL);
+    phase() = v_cur() = v_trg() = 0L;
+    da() = a_cur() = v_fade() = 0L;
+    following() = false;
+    cancelStop();
+    pulsed() = 0L;
+    gearLimit = NO_LIMIT;
     // maxSteps = MAX_LONG;
     // minSteps = MIN_LONG;
-    stepDir = 1L;
-    digitalWrite(stp, LOW);
-    digitalWrite(dir, posDirSignal);
+    stepDir() = 1;
+    output(stp, LOW);
+    output(dir, posDirSignal);
     microstep(MS_SLOW);
     disable();
   }
 
-  void exec() {
-    if(isFrozen()){
-      // Serial.print("Frozen, awaken: ");
-      // Serial.println(ident);
-      triggerUpdate();
+  // --- step tick (timer interrupt) -------------------------------------------
+  /**
+   * Rising phase of the tick, for all the axes in one pass over axes.h
+   * (the rare cases go through the Stepper views)
+   */
+  static void execAll() {
+    axes::pulsing = 0;
+    for(uint8_t i = 0; i < axes::numAxes; ++i){
+      axes::pulsed[i] = 0L;
+      if(axes::hardware[i]){
+        // the step timer follows the speed ramp (see updateTimer())
+        if(axes::v_cur[i] != axes::v_trg[i]){
+          axes::v_cur[i] = axes::views[i]->nextSpeed(axes::v_cur[i], axes::v_trg[i]);
+          if(axes::v_cur[i] == axes::v_trg[i])
+            axes::changed |= uint8_t(1 << i); // end of the ramp
+        }
+        continue;
+      }
+      if(axes::v_cur[i] != axes::v_trg[i]){
+        axes::views[i]->updateSpeed();
+        if(axes::v_cur[i] == axes::v_trg[i])
+          axes::changed |= uint8_t(1 << i); // end of the ramp
+      }
+      long v = axes::v_cur[i];
+      if(!v){
+        // back to the finest gear once stopped
+        if(axes::gear[i] && axes::topGear[i] && !axes::following[i])
+          axes::views[i]->setGear(0);
+        continue;
+      }
+      // phase accumulator: the distance travelled during this tick,
+      // the remainder of a step carries over to the next one
+      if(v < 0L) v = -v;
+      long phase = axes::phase[i] + v;
+      long stepPhase = ticker::STEP_PHASE << axes::gear[i];
+      if(phase >= stepPhase){
+        phase -= stepPhase;
+        // the step was due phase / v ticks ago
+        timing::pulse(i, phase, v);
+        if(!axes::enabled[i])
+          axes::views[i]->enable();
+        axes::pulsing |= uint8_t(1 << i);
+        // update position
+        long delta = 1L << axes::gear[i];
+        axes::steps[i] += axes::stepDir[i] < 0 ? -delta : delta;
+        axes::pulsed[i] = delta;
+        // brake and halt at a position (see stopAt())
+        if(axes::stopping & uint8_t(1 << i)){
+          axes::views[i]->stopTick();
+          if(!axes::v_cur[i])
+            phase = 0L; // halted
+        }
+        // shift gears right after a step (the mode pins settle until the next one)
+        if(axes::topGear[i])
+          axes::views[i]->autoShift();
+      }
+      axes::phase[i] = phase;
+    }
+  }
+
+  // --- soft limits (main loop) ----------------------------------------------
+  /**
+   * The step tick has no bound check: the targets of the controllers are
+   * checked once by their setTarget(), and the speed moves here, which
+   * brakes when their stop would pass a bound, and halts at a bound
+   * (e.g. a new bound from an endstop, see react()).
+   * Returns whether the axis had to halt.
+   */
+  bool guardBounds(){
+    if(following()) return false; // within a checked line
+    long v;
+    {
+      CriticalSection cs;
+      v = v_cur() ? v_cur() : v_trg();
     }
-  	if(isTriggering() && canTrigger()){
-      // arduino::printf("Trigger %c up\n", ident);
-      enable();
-  		digitalWrite(stp, HIGH);
-  		// update position
-  		steps += stepDir * stepDelta;
-  	}
+    if(!v) return false;
+    if(!canTrigger(sign(v))){
+      if(hardware()) finishTimer();
+      CriticalSection cs;
+      halt();
+      return true;
+    }
+    long stop = stepsToSpeed(IDLE_SPEED);
+    if(v > 0L ? stop > maxSteps() : stop < minSteps()){
+      moveToSpeed(IDLE_SPEED);
+      notify();
+    }
+    return false;
   }
 
-  void release() {
-  	if(isRunning()){
-  		if(isTriggering()){
-        // arduino::printf("Trigger %c down\n", ident);
-  			digitalWrite(stp, LOW);
-  			triggerUpdate();
-  		}
-  		++count;
-      // Serial.print("running for count=");
-      // Serial.println(count, DEC);
-      
-      // if we went too far, stop everything now
-      if(!canTrigger()){
-        f_trg = f_cur = IDLE_FREQ;
-      }
-  	}
+  // --- following (steps driven by a Locator line) ----------------------------
+  void follow(long d){
+    CriticalSection cs;
+    halt(); // no self-timed steps while following
+    following() = true;
+    if(d * stepDir() < 0L){
+      stepDir() = sign(d);
+      output(dir, stepDir() > 0L ? posDirSignal : negDirSignal);
+    }
+  }
+  void unfollow(){
+    CriticalSection cs;
+    following() = false;
+    notify();
+  }
+  // step now, within the rising phase of the tick (after exec),
+  // for the leader of this follower (see timing::follow())
+  void pulse(const Stepper &lead){
+    timing::follow(ax, lead.ax);
+    enable();
+    axes::pulsing |= uint8_t(1 << ax);
+    steps() += stepDir() * delta();
+    pulsed() = delta();
+  }
+  // step now towards d, e.g. a follower that also goes back
+  void pulse(long d, const Stepper &lead){
+    if(d * stepDir() < 0L){
+      stepDir() = sign(d);
+      output(dir, stepDir() > 0L ? posDirSignal : negDirSignal);
+    }
+    pulse(lead);
+  }
+  // lead a line at v (steps/s) right away, within the tick,
+  // e.g. a follower that becomes the major axis at a junction
+  void lead(long v){
+    following() = false;
+    cancelStop();
+    long v_t = clampSpeed(ticker::fixedSpeed(v));
+    if(std::abs(v_t) > v_max())
+      v_t = sign(v_t) * v_max(); // the gear shifts up from there
+    v_cur() = v_trg() = v_t;
+    phase() = 0L;
+    notify();
+    if(v_cur() * stepDir() < 0L){
+      a_cur() = v_fade() = 0L;
+      stepDir() = sign(v_cur());
+      output(dir, stepDir() > 0L ? posDirSignal : negDirSignal);
+    }
+  }
+  // stop immediately, without deceleration
+  void halt(){
+    cancelStop();
+    v_trg() = v_cur() = IDLE_SPEED;
+    a_cur() = v_fade() = 0L;
+    phase() = 0L;
+    notify();
+  }
+  /**
+   * Whether the axis had an event for its controller since the last call:
+   * end of a ramp, halt (end of a line or a timer move, bound), brake
+   * before a bound, or a follower released. Controllers recompute their
+   * moves on these only, instead of every loop (see Locator::update).
+   */
+  bool takeEvent(){
+    uint8_t bit = uint8_t(1 << ax);
+    CriticalSection cs;
+    bool e = (axes::changed & bit) != 0;
+    axes::changed &= uint8_t(~bit);
+    return e;
   }
   
   void enable(){
-    if(!enabled){
-      digitalWrite(en, LOW);
-      enabled = true;
+    if(!enabled()){
+      output(en, LOW);
+      enabled() = true;
       if(debugMode > 1) Serial.println("enable");
     }
   }
 
   void disable(){
-    if(enabled && !isRunning()){
-      digitalWrite(en, HIGH);
-      enabled = false;
+    CriticalSection cs;
+    if(enabled() && !isRunning()){
+      output(en, HIGH);
+      enabled() = false;
       if(debugMode > 1) Serial.println("disable");
     }
   }
 
   void microstep(byte mode = MS_SLOW, bool forceDisable = false) {
+    // the timer steps at the new size from a stop
+    bool restart = hardware() && hwstep::isRunning(timer);
+    if(hardware()) finishTimer();
+    CriticalSection cs;
     enable();
     stepMode = mode;
-    stepDelta = stepsForMode(mode);
+    long size = stepsForMode(mode);
+    if(size){
+      gear() = 0;
+      while((1L << gear()) < size) ++gear();
+      v_max() = gearSpeed(gear());
+      v_start() = gearStart[gear()];
+    }
     if(debugMode > 0){
       Serial.print("Microstep/"); Serial.print(ident);
-      Serial.print(": "); Serial.println(stepDelta, DEC);
-    }
-    int  ms[] = { ms1, ms2, ms3 };
-    byte mask[] = { B100, B010, B001 };
-    for(int i = 0; i < 3; ++i){
-      digitalWrite(ms[i], mask[i] & mode ? HIGH : LOW);
+      Serial.print(": "); Serial.println(delta(), DEC);
     }
+    writeMode(mode);
+    if(restart)
+      hwstep::setRate(timer, std::abs(ticker::stepsPerSecond(v_cur())) / delta());
     if(forceDisable)
       disable();
   }
+
+  // --- gears (automatic microstep shifts) ------------------------------------
+  /**
+   * Coarsest microstep mode of the automatic shifts (MS_1_16 = no shift).
+   * Gears go up when the speed saturates the current mode (see speeds.h)
+   * and down when the finer mode can run it again, or to fit a limit.
+   * Shifts to coarser modes only happen at positions aligned to the new
+   * step size, so that the position stays exact.
+   */
+  void setGearing(byte mode){
+    long delta = stepsForMode(mode);
+    CriticalSection cs;
+    topGear() = 0;
+    while((1L << topGear()) < delta) ++topGear();
+  }
+  // largest step size of the next steps (e.g. the distance to a target)
+  void limitGear(unsigned long distance){
+    if(hardware()) return; // see moveTimerBy()
+    CriticalSection cs;
+    gearLimit = distance;
+    while(gear() && (unsigned long)delta() > distance)
+      setGear(gear() - 1);
+  }
+  // shift one gear towards g, if possible (for followers)
+  void shiftTowards(uint8_t g){
+    if(hardware())
+      return;
+    if(g > gear())
+      shiftTo(gear() + 1);
+    else if(g < gear())
+      setGear(gear() - 1);
+  }
+
+  // --- hardware steps (step timers, see hwstep.h) ---------------------------
+  void setTimer(uint8_t channel){
+    timer = channel;
+    hwstep::attach(channel, stp, ax);
+  }
+  void useTimer(bool on){
+    if(on && timer == NO_TIMER){
+      error = ERR_NO_TIMER;
+      return;
+    }
+    if(hardware()) finishTimer();
+    CriticalSection cs;
+    halt();
+    hardware() = on;
+    v_max() = gearSpeed(gear());
+  }
+  /**
+   * Move by d (1/16 microsteps) on the step timer, which stops by itself
+   * after the last step. The speed is set with moveToSpeed() as usual,
+   * in the coarsest gear aligned with both the position and the distance.
+   */
+  void moveTimerBy(long d){
+    if(!hardware()){
+      error = ERR_NO_TIMER;
+      return;
+    }
+    finishTimer();
+    CriticalSection cs;
+    halt();
+    uint8_t g = topGear();
+    while(g && ((steps() | d) & ((1L << g) - 1L))) --g;
+    if(g != gear()) setGear(g);
+    if(d * stepDir() < 0L){
+      stepDir() = sign(d);
+      dir.write(stepDir() > 0L ? posDirSignal : negDirSignal);
+    }
+    hwstep::setLimit(timer, std::abs(d) >> g);
+  }
+  /**
+   * Feed the current speed to the step timer (main loop),
+   * and end the moves of moveTimerBy()
+   */
+  void updateTimer(){
+    if(!hardware()) return;
+    if(hwstep::isDone(timer)){
+      stopTimer();
+      return;
+    }
+    long v;
+    {
+      CriticalSection cs; // snapshot of the ramp
+      v = v_cur();
+    }
+    unsigned long r = std::abs(ticker::stepsPerSecond(v)) / delta();
+    if(!r){
+      hwstep::stop(timer); // the count goes on with the next rate
+      return;
+    }
+    if(v * stepDir() < 0L){
+      if(!stopTimer())
+        return; // direction changes on a low pin (next update)
+      CriticalSection cs;
+      stepDir() = sign(v);
+      dir.write(stepDir() > 0L ? posDirSignal : negDirSignal);
+    }
+    if(r != hwstep::rate[timer] || !hwstep::isRunning(timer)){
+      {
+        CriticalSection cs;
+        enable();
+      }
+      hwstep::setRate(timer, r);
+    }
+  }
   
+  // --- stops of the step tick -----------------------------------------------
+  /**
+   * Brake and halt at position z (1/16 microsteps) from the step tick,
+   * the counterpart of moveTimerBy(): the speed is set with moveToSpeed()
+   * before, the tick brakes down to the start speed in time, shifts the
+   * gears down on the way, and halts on z exactly (with an event).
+   */
+  void stopAt(long z){
+    CriticalSection cs;
+    long d = z - steps();
+    if(!d){
+      halt(); // already there
+      return;
+    }
+    stopPos = z;
+    stopDir = d < 0L ? -1 : 1;
+    // down to the start speed, or halfway for short moves
+    long v = ticker::stepsPerSecond(std::max(std::abs(v_cur()), std::abs(v_trg())));
+    brakeLeft = std::min(std::abs(rampBetweenSpeeds(v, ticker::stepsPerSecond(v_start())).steps),
+                         std::abs(d) / 2L);
+    axes::stopping |= uint8_t(1 << ax);
+    limitGear(std::abs(d));
+  }
+  // the speed stays as is (e.g. a line takes the axis over)
+  void cancelStop(){
+    axes::stopping &= uint8_t(~(1 << ax));
+  }
+  bool stopsAt(long z) const {
+    return (axes::stopping & uint8_t(1 << ax)) && stopPos == z;
+  }
+
   // --- setters ---------------------------------------------------------------
-  void moveToFreq(long f = IDLE_FREQ){
-  	f_trg = f; // this is our new target
+  // target speed (steps/s, in 1/16 microsteps), signed
+  void moveToSpeed(long v = IDLE_SPEED){
+    if(hardware() && hwstep::hasLimit(timer) && v * stepDir() < 0L)
+      v = IDLE_SPEED; // no reversal within moveTimerBy()
+    long v_t = clampSpeed(ticker::fixedSpeed(v));
+    CriticalSection cs;
+  	v_trg() = v_t; // this is our new target
+  }
+  // limits of a microstep mode (see speeds.h)
+  void setSpeedProfile(const speeds::Profile &p){
+    uint8_t g = 0;
+    while(g + 1 < NUM_GEARS && (16 >> g) > p.microsteps) ++g;
+    long step = 1L << g; // in 1/16 microsteps
+    CriticalSection cs;
+    gearMax[g] = ticker::fixedSpeed(ticker::rateOfPeriod(p.fastest) * step);
+    gearStart[g] = ticker::fixedSpeed(ticker::rateOfPeriod(p.start) * step);
+    if(g == gear()){
+      v_max() = gearSpeed(g);
+      v_start() = gearStart[g];
+    }
+    v_trg() = clampSpeed(v_trg());
   }
   void resetPosition(long absoluteSteps = 0){
-    long delta = absoluteSteps - steps; // remember transformation
-  	steps = absoluteSteps;
+    CriticalSection cs;
+    long delta = absoluteSteps - steps(); // remember transformation
+  	steps() = absoluteSteps;
     
     // apply transformation to min/max
-    if(minSteps != MIN_LONG){
+    if(minSteps() != MIN_LONG){
       if(delta < 0L)
-        minSteps = std::max<long>(MIN_LONG - delta, minSteps) + delta; // avoid underflow
+        minSteps() = std::max<long>(MIN_LONG - delta, minSteps()) + delta; // avoid underflow
       else
-        minSteps += delta;
+        minSteps() += delta;
     }
-    if(maxSteps != MAX_LONG){
+    if(maxSteps() != MAX_LONG){
       if(delta > 0L)
-        maxSteps = std::min<long>(MAX_LONG - delta, maxSteps) + delta; // avoid overflow
+        maxSteps() = std::min<long>(MAX_LONG - delta, maxSteps()) + delta; // avoid overflow
       else
-        minSteps += delta;
+        minSteps() += delta;
     }
   }
   void resetBounds() {
-    minSteps = MIN_LONG;
-    maxSteps = MAX_LONG;
-  }
-  void resetMemory(){
-    f_mem = IDLE_FREQ;
+    CriticalSection cs;
+    minSteps() = MIN_LONG;
+    maxSteps() = MAX_LONG;
   }
   void setMaxValue(long maxValue, bool rangeUpdate = true){
-    maxSteps = maxValue;
+    CriticalSection cs;
+    maxSteps() = maxValue;
     // reset current steps to be within bounds (so we don't get stuck out of bounds)
-    if(steps > maxSteps) steps = maxSteps;
+    if(steps() > maxSteps()) steps() = maxSteps();
 
     // propagate range
-    if(stepRange && rangeUpdate) setMinValue(maxSteps - stepRange, false);
+    if(stepRange && rangeUpdate) setMinValue(maxSteps() - stepRange, false);
   }
   void setMinValue(long minValue, bool rangeUpdate = true){
-    minSteps = minValue;
+    CriticalSection cs;
+    minSteps() = minValue;
     // reset current steps to be within bounds
-    if(steps < minSteps) steps = minSteps;
+    if(steps() < minSteps()) steps() = minSteps();
 
     // propagate range
-    if(stepRange && rangeUpdate) setMaxValue(minSteps + stepRange, false);
+    if(stepRange && rangeUpdate) setMaxValue(minSteps() + stepRange, false);
   }
   void setRange(unsigned long range){
     stepRange = range;
     // /!\ both minSteps and maxSteps should not be already set, else one will be cleared
-    if(minSteps != MIN_LONG){
-      setMaxValue(minSteps + stepRange, false);
-    } else if(maxSteps != MAX_LONG){
-      setMinValue(maxSteps - stepRange, false);
+    if(minSteps() != MIN_LONG){
+      setMaxValue(minSteps() + stepRange, false);
+    } else if(maxSteps() != MAX_LONG){
+      setMinValue(maxSteps() - stepRange, false);
     }
   }
-  void setDeltaFreq(unsigned long deltaF = 1L){
-  	df = deltaF;
-    if(df == 0L){
-      error = ERR_INVALID_DELTA_F;
+  // acceleration (steps/s²), only used above the start speed
+  void setAcceleration(unsigned long a = DEFAULT_ACCEL){
+    if(a == 0UL){
+      error = ERR_INVALID_ACCEL;
+      return;
     }
+    long delta = ticker::fixedAccel(a);
+    CriticalSection cs;
+  	dv() = delta;
   }
-  void setSafeFreq(unsigned long f0 = 100L){
-  	f_safe = f0;
+  // jerk (steps/s³) of the S-curve ramps, 0 for constant accelerations
+  void setJerk(unsigned long j = 0UL){
+    long delta = ticker::fixedJerk(j);
+    CriticalSection cs;
+    if(delta == da())
+      return;
+    da() = delta;
+    a_cur() = v_fade() = 0L; // the current ramp starts over
+  }
+  // speed (steps/s) that can be reached directly, in all gears
+  void setStartSpeed(unsigned long v0){
+    long v = ticker::fixedSpeed(v0);
+    CriticalSection cs;
+  	v_start() = v;
+    for(uint8_t g = 0; g < NUM_GEARS; ++g)
+      gearStart[g] = v;
   }
   
   // --- getters ---------------------------------------------------------------
-  long targetFreq() const {
-  	return f_trg;
+  long targetSpeed() const {
+    CriticalSection cs;
+  	return ticker::stepsPerSecond(v_trg());
+  }
+  long currentSpeed() const {
+    CriticalSection cs;
+  	return ticker::stepsPerSecond(v_cur());
+  }
+  long startSpeed() const {
+    return ticker::stepsPerSecond(v_start());
+  }
+  long maxSpeed() const {
+    return ticker::stepsPerSecond(v_max());
   }
-  long currentFreq() const {
-  	return f_cur;
+  // fastest speed with gears
+  long topSpeed() const {
+    return ticker::stepsPerSecond(hardware() ? gearSpeed(gear()) : gearMax[std::max(gear(), topGear())]);
+  }
+  uint8_t currentGear() const {
+    return gear();
+  }
+  float acceleration() const {
+    return ticker::accelOf(dv());
+  }
+  float jerk() const {
+    return ticker::jerkOf(da());
   }
   long value() const {
-  	return steps;
+    CriticalSection cs;
+    if(hardware())
+      return steps() + stepDir() * delta() * long(hwstep::steps(timer));
+  	return steps();
+  }
+  // position of the motor, behind value() by the queued steps (see events.h)
+  long motorValue() const {
+    return value() - events::pending(ax);
+  }
+  // distance left before the end of moveTimerBy() (1/16 microsteps)
+  unsigned long timerLeft() const {
+    return hardware() ? hwstep::stepsLeft(timer) << gear() : 0UL;
   }
   unsigned long stepSize() const {
-  	return stepDelta;
+  	return delta();
+  }
+  long direction() const {
+    return stepDir();
   }
   long maxValue() const {
-    return maxSteps;
+    return maxSteps();
   }
   long minValue() const {
-    return minSteps;
+    return minSteps();
   }
   unsigned long range() const {
     return stepRange;
   }
   
   // --- estimators ------------------------------------------------------------
-  unsigned long timeBetweenFreq(long f_c, long f_t, long df) const {
-  	unsigned long t = 0L;
-  	long f = f_c;
-  	while(f != f_t){
-  		t += std::abs(f);
-  		f = updateFreq(f, f_t, df);
-  	}
-  	return t;
-  }
-  unsigned long timeToFreq(long f_t, long df) const {
-  	unsigned long t = timeBetweenFreq(f_cur, f_t, df);
-  	if(t)
-  		return t + 1L - count; // account for current count
-  	else
-  		return 0L;
-  }
-  long stepsToFreq(long f_t, long df, unsigned long stpDelta) const {
-  	long d = steps;
-  	long f = f_cur;
-  	while(f != f_t){
-      if(stpDelta > 1L){
-        d += sign(f) * stpDelta;
-        stpDelta = 1L; // set to low microstep
-      } else {
-    		d += sign(f);
-    		f = updateFreq(f, f_t, df);
+  /**
+   * Ramp of updateSpeed() from v_c until v_t (steps/s):
+   * - time: duration in microseconds
+   * - steps: number of steps (signed)
+   * Ramps have constant acceleration, or are S-curves with a jerk,
+   * so each one is in closed form.
+   */
+  struct Ramp {
+    unsigned long time;
+    long steps;
+  };
+  Ramp rampBetweenSpeeds(long v_c, long v_t) const {
+    return rampBetweenSpeeds(v_c, v_t, ticker::accelOf(dv()));
+  }
+  // same with another acceleration a (steps/s²), e.g. of a planned line
+  Ramp rampBetweenSpeeds(long v_c, long v_t, float a) const {
+    long c = ticker::fixedSpeed(v_c), t = ticker::fixedSpeed(v_t);
+    float time = 0.0f, dist = 0.0f;
+    while(c != t){
+      // direct changes (at most two of them)
+      if(isDirectChange(c, t)){
+        c = directSpeed(t);
+        continue;
       }
-  	}
-  	return d;
+      // ramp towards the target, or down to the start speed
+      long end = sameDirection(c, t) && !isSafeSpeed(t) ? t : sign(c) * rampStart();
+      float v0 = float(std::abs(c)) / float(1L << ticker::SPEED_SHIFT);
+      float v1 = float(std::abs(end)) / float(1L << ticker::SPEED_SHIFT);
+      float t_r = std::abs(v1 - v0) / a;
+      if(da()){
+        // S-curve: the acceleration goes up and down at the jerk j,
+        // to the full acceleration a if the ramp is long enough
+        float j = ticker::jerkOf(da());
+        if(std::abs(v1 - v0) * j >= a * a)
+          t_r += a / j;
+        else
+          t_r = 2.0f * sqrt(std::abs(v1 - v0) / j);
+      }
+      time += t_r;
+      dist += float(sign(c)) * 0.5f * (v0 + v1) * t_r; // symmetric ramps
+      c = end;
+    }
+    Ramp r = { (unsigned long)(time * 1e6f), long(dist) };
+    return r;
   }
-  long stepsToFreq(long f_t, long df) const {
-    return stepsToFreq(f_t, df, stepDelta);
+  unsigned long timeToSpeed(long v_t) const {
+    long v;
+    {
+      CriticalSection cs; // snapshot of the timer state
+      v = v_cur();
+    }
+    return rampBetweenSpeeds(ticker::stepsPerSecond(v), v_t).time;
   }
-  long stepsToFreq(long f_t) const {
-  	return stepsToFreq(f_t, df);
+  long stepsToSpeed(long v_t) const {
+  	long d, v;
+    {
+      CriticalSection cs; // snapshot of the timer state
+      d = value();
+      v = v_cur();
+    }
+  	return d + rampBetweenSpeeds(ticker::stepsPerSecond(v), v_t).steps;
   }
   
   // --- checks ----------------------------------------------------------------
   bool isRunning() const {
-    return f_trg != IDLE_FREQ || f_cur != IDLE_FREQ;
+    CriticalSection cs;
+    return v_trg() != IDLE_SPEED || v_cur() != IDLE_SPEED || following()
+        || (hardware() && hwstep::hasLimit(timer)); // see moveTimerBy()
+  }
+  bool usesTimer() const {
+    return hardware();
+  }
+  bool isFollowing() const {
+    return following();
+  }
+  bool hasPulsed() const {
+    return pulsed() != 0L;
   }
-  const bool &isEnabled() const {
-    return enabled;
+  // size of the step of this tick (0 if none)
+  long pulseSize() const {
+    return pulsed();
   }
-  bool isSafeFreq(long f) const {
-  	return f == IDLE_FREQ || std::abs(f) >= f_safe;
+  bool isBlocked() const {
+    CriticalSection cs;
+    return !canTrigger(stepDir());
   }
-  bool hasSafeFreq() const {
-  	return isSafeFreq(f_cur);
+  // whether a position is within the bounds (both included)
+  bool isWithinBounds(long s) const {
+    return minSteps() <= s && s <= maxSteps();
+  }
+  bool isEnabled() const {
+    return enabled();
+  }
+  bool hasSafeSpeed() const {
+    CriticalSection cs;
+  	return isSafeSpeed(v_cur());
   }
   bool hasCorrectDirection() const {
-  	return f_cur * f_trg >= 0L;
+    CriticalSection cs;
+  	return !v_cur() || !v_trg() || sameDirection(v_cur(), v_trg());
   }
   bool hasRange() const {
     return stepRange != 0L;
@@ -314,157 +752,289 @@ public:
 
 protected:
 
-  void triggerUpdate() {
-    count = 0L; // reset
-    long f_tmp = f_cur;
-    f_cur = updateFreq(f_cur, f_trg);
-    // prevent oscillation (special case for IDLE and opposite side)
-    if(false && f_mem && f_cur != f_tmp && std::abs(f_cur - f_tmp) == 1L && f_cur == f_mem
-    && f_tmp != IDLE_FREQ && f_tmp * f_trg > 0){
-      // revert change
-      f_cur = f_tmp;
-      if(debugMode > 1) Serial.println("Freq change abortion because of memory.");
-    } else {
-      // remember change
-      f_mem = f_tmp;
-    }
-    if(f_cur != f_tmp && debugMode > 0){
-      Serial.print("freqUpdate(");
-      Serial.print(ident);
-      Serial.print("): ");
-      Serial.println(f_cur, DEC);
-    }
+  /**
+   * Stop the timer and integrate its steps into the position once its
+   * pin is low, whether it is stopped (see hwstep::stop()): the main
+   * loop tries again on its next update
+   */
+  bool stopTimer(){
+    hwstep::stop(timer);
+    if(hwstep::isRunning(timer))
+      return false;
+    bool done = hwstep::isDone(timer);
+    CriticalSection cs;
+    steps() += stepDir() * delta() * long(hwstep::steps(timer));
+    hwstep::reset(timer);
+    if(done) halt(); // end of moveTimerBy()
+    return true;
+  }
+  // same, for the commands that need it stopped now (at most half a step)
+  void finishTimer(){
+    while(!stopTimer());
+  }
+
+  void updateSpeed() {
+    v_cur() = nextSpeed(v_cur(), v_trg());
     // did we change direction?
-    if(f_cur * stepDir < 0L){
-      stepDir = sign(f_cur);
+    if(v_cur() * stepDir() < 0L){
+      stepDir() = sign(v_cur());
+      phase() = 0L;
       // arduino::printf("Changing dir of '%c'.\n", ident);
-      digitalWrite(dir, stepDir > 0L ? posDirSignal : negDirSignal);
+      output(dir, stepDir() > 0L ? posDirSignal : negDirSignal);
     }
   }
   
-  bool isTriggering() const {
-  	return f_cur && count >= std::abs(f_cur);
+  // event for the controller (see takeEvent)
+  void notify() {
+    CriticalSection cs;
+    axes::changed |= uint8_t(1 << ax);
+  }
+
+  // pin writes keep their place among the queued pulses (see events.h),
+  // step timers write theirs directly
+  void output(const Pin &pin, int level) {
+    if(events::isActive() && !hardware())
+      events::defer(pin, level);
+    else
+      pin.write(level);
   }
-  bool canTrigger() const {
-    long nextStep = steps + stepDir * stepDelta;
-    if(stepDir < 0)
-      return nextStep > minSteps;
+  
+  // whether a step in direction d stays within the bounds
+  bool canTrigger(long d) const {
+    long s = value();
+    if(d < 0L)
+      return s - delta() >= minSteps();
     else
-      return nextStep < maxSteps;
+      return s + delta() <= maxSteps();
+  }
+  // step size (1/16 microsteps)
+  long delta() const {
+    return 1L << gear();
   }
 
-  bool isFrozen() const {
-    return !f_cur && f_trg;
+  // --- gear shifts -----------------------------------------------------------
+  void writeMode(byte mode) {
+    const Pin *ms[] = { &ms1, &ms2, &ms3 };
+    byte mask[] = { B100, B010, B001 };
+    for(int i = 0; i < 3; ++i){
+      output(*ms[i], mask[i] & mode ? HIGH : LOW);
+    }
   }
-  
-  long updateFreq(long f_c, long f_t, long df) const{
-    if(debugMode > 2){
-      Serial.print("updateFreq: f_c="); Serial.print(f_c, DEC);
-      Serial.print(", f_t="); Serial.print(f_t, DEC);
-      Serial.print(", df="); Serial.println(df, DEC);
-    }
-  	// update frequency only if needed
-		if(f_c == f_t)
-			return f_t;
-			
-		// safety targets
-		bool safe_cur = isSafeFreq(f_c);
-		bool safe_trg = isSafeFreq(f_t);
-		
-		// are both safe frequencies?
-		if(safe_cur && safe_trg){
-			f_c = f_t; // safe to change directly
-		} else
-		
-		// are both frequencies on the same direction?
-		if(f_c * f_t > 0){
-			// get closer
-			long s0 = sign(f_t - f_c);
-      if(safe_cur){
-        long f_c1 = f_c + s0 * df; // moving normally using acceleration
-        long f_c2 = f_safe * sign(f_t);
-        f_c = std::abs(f_c2 - f_t) < std::abs(f_c1 - f_t) ? f_c2 : f_c1;
-      } else {
-			  f_c += s0 * df;
-      }
-			if(sign(f_t - f_c) != s0){
-				// we reach the target (or went past)
-				f_c = f_t;
-			}
-		} else
+  void setGear(uint8_t g) {
+    gear() = g;
+    stepMode = modeForSteps(delta());
+    v_max() = gearSpeed(g);
+    v_start() = gearStart[g];
+    writeMode(stepMode);
+  }
+  // coarser gears need an aligned position and room before the limit
+  bool shiftTo(uint8_t g) {
+    long size = 1L << g;
+    if(g > topGear() || (steps() & (size - 1L)) || (unsigned long)size > gearLimit)
+      return false;
+    setGear(g);
+    return true;
+  }
+  // after a step of the tick towards the position of stopAt()
+  void stopTick() {
+    long left = (stopPos - steps()) * stopDir;
+    if(left <= 0L){
+      halt();
+      return;
+    }
+    limitGear(left);
+    if(left <= brakeLeft && v_trg() * stopDir > v_start())
+      v_trg() = stopDir * v_start(); // planned deceleration
+  }
+  void autoShift() {
+    long v = std::abs(v_cur());
+    if(gear() < topGear() && v >= v_max() && std::abs(v_trg()) > v_max()){
+      shiftTo(gear() + 1); // saturated
+    } else if(gear()){
+      long v_down = gearMax[gear() - 1] - (gearMax[gear() - 1] >> 3);
+      if(v < v_down)
+        setGear(gear() - 1);
+    }
+  }
+
+  // --- speed model (fixed-point speeds) --------------------------------------
+  long clampSpeed(long v) const {
+    long v_top = hardware() ? gearSpeed(gear()) : gearMax[std::max(gear(), topGear())];
+    if(std::abs(v) > v_top)
+      return sign(v) * v_top;
+    return v;
+  }
+  // fastest speed of a gear (see speeds.h), step timers only have a maximum rate
+  long gearSpeed(uint8_t g) const {
+    return hardware() ? ticker::fixedSpeed(hwstep::MAX_RATE << g) : gearMax[g];
+  }
+  // start speed at the end of a ramp (finest gear when shifting)
+  long rampStart() const {
+    return topGear() ? gearStart[0] : v_start();
+  }
+  bool isSafeSpeed(long v) const {
+  	return std::abs(v) <= v_start();
+  }
+  static bool sameDirection(long v0, long v1) {
+    return v0 && v1 && (v0 < 0L) == (v1 < 0L);
+  }
+  // whether the next update jumps directly instead of accelerating
+  bool isDirectChange(long v_c, long v_t) const {
+    if(!isSafeSpeed(v_c))
+      return false;
+    return isSafeSpeed(v_t) || !sameDirection(v_c, v_t) || std::abs(v_c) < v_start();
+  }
+
+  // speed of a direct change towards v_t
+  long directSpeed(long v_t) const {
+    return isSafeSpeed(v_t) ? v_t : sign(v_t) * v_start();
+  }
+
+  // speed after one tick
+  long nextSpeed(long v_c, long v_t) {
+  	// update speed only if needed
+		if(v_c == v_t)
+			return v_t;
 		
-		// we must change direction first, but is it safe?
-		if(safe_cur){
-			f_c = f_safe * sign(f_t);
-		} else
+		// safe to change directly?
+		if(isDirectChange(v_c, v_t)){
+			a_cur() = v_fade() = 0L;
+			return directSpeed(v_t);
+		}
 		
-		// we must go to a safe frequency before changing direction
-		{
-			f_c += sign(f_c) * df;
+		// accelerate towards the target, or slow down to the start speed
+		// before changing direction or reaching a safe target (where the
+		// change is direct, so that S-curves ease out before it)
+		long v_g = sameDirection(v_c, v_t) && !isSafeSpeed(v_t) ? v_t : sign(v_c) * v_start();
+		if(da())
+			v_c += easedChange(v_g - v_c);
+		else if(v_c < v_g)
+			v_c = std::min(v_c + dv(), v_g);
+		else
+			v_c = std::max(v_c - dv(), v_g);
+		if(v_c == v_g)
+			a_cur() = v_fade() = 0L;
+		// within the limit of the current gear
+		if(std::abs(v_c) > v_max()){
+			a_cur() = v_fade() = 0L;
+			return sign(v_c) * v_max();
 		}
+		return v_c;
+  }
 
-    if(debugMode > 2){
-      Serial.print("f_c <- "); Serial.println(f_c, DEC);
+  /**
+   * Speed change of this tick along an S-curve, with r left to change:
+   * the change per tick (a_cur) goes up by da each tick, up to dv,
+   * as long as it can still fade out within the change left
+   * (v_fade = a_cur + (a_cur - da) + ... + da), and back down once
+   * it cannot stay at a_cur anymore, so that the speed
+   * eases in and out of the ramp quadratically (quadInOut in main4/easing.h),
+   * with additions only.
+   */
+  long easedChange(long r) {
+    long d = r < 0L ? -1L : 1L;
+    long a = d * a_cur(); // along the change
+    r *= d;
+    if(a <= 0L){
+      a += da(); // turning around
+      v_fade() = a > 0L ? a : 0L;
+    } else if(v_fade() > r || a > dv()){
+      if(a > da()){
+        v_fade() -= a;
+        a -= da();
+      }
+    } else if(a + da() <= dv() && v_fade() + a + da() <= r){
+      a += da();
+      v_fade() += a;
     }
-		return f_c;
-  }
-  
-  long updateFreq(long f_c, long f_t) const {
-  	return updateFreq(f_c, f_t, df);
+    a_cur() = d * a;
+    return d * std::min(a, r);
   }
 
 public:
   void debug() {
     Serial.print("debug("); Serial.print(ident); Serial.println("):");
-    Serial.print("count  "); Serial.println(count, DEC);
-    Serial.print("f_cur  "); Serial.println(f_cur, DEC);
-    Serial.print("f_trg  "); Serial.println(f_trg, DEC);
-    Serial.print("f_mem  "); Serial.println(f_mem, DEC);
-    Serial.print("df     "); Serial.println(df, DEC);
-    Serial.print("f_safe "); Serial.println(f_safe, DEC);
-    Serial.print(ident); Serial.print(", "); Serial.print(steps, DEC); Serial.print(", ");
-      Serial.print(stepDelta, DEC); Serial.print(", "); Serial.print(stepDir, DEC); Serial.print(" in [");
-      Serial.print(minSteps, DEC); Serial.print(", "); Serial.print(maxSteps, DEC); Serial.println("]");
+    Serial.print("phase  "); Serial.println(phase(), DEC);
+    Serial.print("v_cur  "); Serial.println(currentSpeed(), DEC);
+    Serial.print("v_trg  "); Serial.println(targetSpeed(), DEC);
+    Serial.print("accel  "); Serial.println(acceleration(), 1);
+    Serial.print("jerk   "); Serial.println(jerk(), 0);
+    Serial.print("v_start "); Serial.println(startSpeed(), DEC);
+    Serial.print("v_max  "); Serial.println(maxSpeed(), DEC);
+    Serial.print("timer  "); Serial.print(hardware() ? 1 : 0, DEC);
+    if(hardware()){
+      Serial.print(", left "); Serial.print(timerLeft(), DEC);
+    }
+    Serial.println();
+    Serial.print("gear   "); Serial.print(gear(), DEC); Serial.print("/"); Serial.print(topGear(), DEC);
+      Serial.print(", limit "); Serial.println(gearLimit, DEC);
+    Serial.print(ident); Serial.print(", "); Serial.print(steps(), DEC); Serial.print(", ");
+      Serial.print(delta(), DEC); Serial.print(", "); Serial.print(int(stepDir()), DEC); Serial.print(" in [");
+      Serial.print(minSteps(), DEC); Serial.print(", "); Serial.print(maxSteps(), DEC); Serial.println("]");
     //arduino::printf("position: stepMode=%d, steps=%d, stepDelta=%d, stepDir=%d\n",
     //                stepMode, steps, stepDelta, stepDir);
   }
 
+  void debugTiming() const {
+    timing::debugAxis(ax, ident);
+  }
+
   void setDebugMode(int m){
     debugMode = m;
   }
 
 private:
+  // index of this axis in the hot state (see axes.h)
+  uint8_t ax;
+  // movement information (fixed-point speeds, see ticker.h)
+  long &phase() const { return axes::phase[ax]; } // fraction of step accumulated (phase accumulator)
+  long &v_cur() const { return axes::v_cur[ax]; }
+  long &v_trg() const { return axes::v_trg[ax]; }
+  // movement profile
+  long &dv() const { return axes::dv[ax]; } // speed change per tick, only above v_start
+  long &da() const { return axes::da[ax]; } // change of dv per tick (jerk, 0 = constant dv)
+  long &a_cur() const { return axes::a_cur[ax]; } // state of the S-curve ramps
+  long &v_fade() const { return axes::v_fade[ax]; }
+  long &v_start() const { return axes::v_start[ax]; } // speed below which a direct speed change is allowed
+  long &v_max() const { return axes::v_max[ax]; } // fastest speed of the current microstep mode
+  // positioning information
+  long &steps() const { return axes::steps[ax]; } // reference number of steps
+  long &maxSteps() const { return axes::maxSteps[ax]; } // boundaries
+  long &minSteps() const { return axes::minSteps[ax]; }
+  long &pulsed() const { return axes::pulsed[ax]; } // size of the step of this tick (0 if none)
+  int8_t &stepDir() const { return axes::stepDir[ax]; } // step direction
+  uint8_t &gear() const { return axes::gear[ax]; } // log2 of the step size
+  uint8_t &topGear() const { return axes::topGear[ax]; } // coarsest gear of the automatic shifts
+  // state
+  bool &enabled() const { return axes::enabled[ax]; }
+  bool &following() const { return axes::following[ax]; } // steps are triggered externally through pulse()
+  bool &hardware() const { return axes::hardware[ax]; } // steps are generated by a step timer (see hwstep.h)
+
   // pins
-  int stp, dir, ms1, ms2, ms3, en;
+  Pin stp, dir, ms1, ms2, ms3, en;
 
   // ident
   char ident;
 
-  // movement information
-  unsigned long count;
-  long f_cur, f_trg, f_mem;
-  // movement profile
-  unsigned long df;  		// maximum absolute delta in frequency, only for f < f_safe
-  unsigned long f_safe; // frequency above which a direct speed change is allowed
+  // speed limits of the gears
+  long gearStart[NUM_GEARS]; // v_start of each gear
+  long gearMax[NUM_GEARS];   // v_max of each gear
   
   // positioning information
   byte stepMode;  // step mode
-  long steps;			// reference number of steps
-  long stepDelta; // step size
-  long stepDir;		// step direction
+  unsigned long gearLimit; // largest step size of the next steps
+  long stopPos;   // position of stopAt()
+  long brakeLeft; // distance left when braking starts
+  int8_t stopDir;
   
   // signal interpretation
   int posDirSignal; // positive direction signal
   int negDirSignal;
 
   // boundaries
-  long maxSteps;
-  long minSteps;
   unsigned long stepRange;
 
-  // state
-  bool enabled;
+  uint8_t timer; // channel of the step timer
+
   int debugMode;
 };
-
-
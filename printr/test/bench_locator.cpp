@@ -0,0 +1,54 @@
+/**
+ * XY controller (see Locator): cost of update() in the main loop along a
+ * queued path, per call and per call that recomputes (on the events of the
+ * axes), and of queueing a segment, in host nanoseconds.
+ */
+#include <time.h>
+#include "host.h"
+
+double now() {
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return double(t.tv_sec) * 1e9 + double(t.tv_nsec);
+}
+
+int main() {
+  host::begin();
+  stpX.resetBounds();
+  stpY.resetBounds();
+  double queueing = 0.0, updating = 0.0, worst = 0.0;
+  unsigned long segments = 0UL, calls = 0UL, events = 0UL;
+  for(int run = 0; run < 20; ++run){
+    vec2 from = locXY.value();
+    for(long k = 1; k <= 40; ++k){
+      vec2 trg = from + vec2(1500L * k, k & 1L ? 400L : 0L);
+      while(locXY.isQueueFull()){
+        // the tick, then the controller, as in the main loop
+        ticker::advance(ticker::TICK_TIME);
+        bool event = axes::changed != 0;
+        double t0 = now();
+        locXY.update();
+        double t = now() - t0;
+        updating += t;
+        worst = std::max(worst, t);
+        ++calls;
+        if(event) ++events;
+      }
+      double t0 = now();
+      locXY.queueTarget(trg);
+      queueing += now() - t0;
+      ++segments;
+    }
+    while(locXY.hasTarget()){
+      ticker::advance(ticker::TICK_TIME);
+      double t0 = now();
+      locXY.update();
+      updating += now() - t0;
+      ++calls;
+    }
+  }
+  printf("update: %.1f ns per call (%lu calls, %lu with events), worst %.0f ns\n",
+         updating / double(calls), calls, events, worst);
+  printf("queue target: %.1f ns\n", queueing / double(segments));
+  return 0;
+}
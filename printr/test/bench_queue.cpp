@@ -0,0 +1,46 @@
+/**
+ * Step queue (see events.h): ticks planned per second by the main loop
+ * (events::fill()) against ticks popped per second by the interrupt
+ * (events::pop()), with the 4 axes of the sketch at cruise, on the host.
+ */
+#include <time.h>
+#include "host.h"
+
+static const long ROUNDS = 200000L;
+
+double now() {
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return double(t.tv_sec) * 1e9 + double(t.tv_nsec);
+}
+
+int main() {
+  host::begin();
+  Stepper *axes[] = { &stpX, &stpY, &stpZ, &stpE0 };
+  static const long speeds[] = { 3000L, 1700L, 900L, 2300L };
+  for(int i = 0; i < 4; ++i){
+    axes[i]->resetBounds();
+    axes[i]->setStartSpeed(5000UL);
+    axes[i]->moveToSpeed(speeds[i]);
+  }
+  ticker::pause(); // popped here only
+  events::setActive(true);
+  double planning = 0.0, popping = 0.0;
+  unsigned long ticks = 0UL;
+  for(long r = 0; r < ROUNDS; ++r){
+    double t0 = now();
+    events::fill();
+    double t1 = now();
+    unsigned int n = events::lead();
+    while(!events::isEmpty())
+      events::pop();
+    double t2 = now();
+    planning += t1 - t0;
+    popping += t2 - t1;
+    ticks += n;
+  }
+  printf("%lu ticks\n", ticks);
+  printf("planned: %.1fM ticks/s\n", double(ticks) / planning * 1e3);
+  printf("popped:  %.1fM ticks/s\n", double(ticks) / popping * 1e3);
+  return 0;
+}
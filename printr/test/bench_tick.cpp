@@ -0,0 +1,55 @@
+/**
+ * Cost of the step tick (rising and falling phases) at cruise,
+ * with the 4 axes of the sketch and with 4 extra ones (8 axes),
+ * in host nanoseconds per tick (best of a few runs).
+ */
+#include <time.h>
+#include "host.h"
+
+static const int PIN = 48; // unused (see bench.h)
+static const long TICKS = 2000000L;
+static const int RUNS = 7;
+
+double now() {
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return double(t.tv_sec) * 1e9 + double(t.tv_nsec);
+}
+
+double nsPerTick() {
+  double best = 0.0;
+  for(int r = 0; r < RUNS; ++r){
+    double t0 = now();
+    for(long n = 0; n < TICKS; ++n){
+      stepRise();
+      stepFall();
+    }
+    double ns = (now() - t0) / double(TICKS);
+    if(!r || ns < best)
+      best = ns;
+  }
+  return best;
+}
+
+int main() {
+  host::begin();
+  Stepper *axes[] = { &stpX, &stpY, &stpZ, &stpE0 };
+  static const long speeds[] = { 3000L, 1700L, 900L, 2300L };
+  for(int i = 0; i < 4; ++i){
+    axes[i]->setStartSpeed(5000UL);
+    axes[i]->moveToSpeed(speeds[i]);
+  }
+  printf("4 axes: %.1f ns/tick\n", nsPerTick());
+
+  Stepper *extra[4];
+  for(int i = 0; i < 4; ++i){
+    extra[i] = new Stepper(PIN, PIN, PIN, PIN, PIN, PIN, 'b');
+    extra[i]->enable();
+    extra[i]->setStartSpeed(5000UL);
+    extra[i]->moveToSpeed(speeds[i] + 100L);
+  }
+  printf("8 axes: %.1f ns/tick\n", nsPerTick());
+  for(int i = 0; i < 4; ++i)
+    delete extra[i];
+  return 0;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+/**
+ * Host build of the sketch, for the tests and benchmarks (see Makefile).
+ *
+ * The Arduino core is mocked (mock/) and the step tick runs on the virtual
+ * clock of ticker.h: each iteration of the main loop costs a given time,
+ * during which the tick phases that are due run, as the timer interrupt
+ * would. The step pins report their rising edges with the virtual time.
+ */
+#include "Arduino.h"
+#include "SD.h"
+
+uint8_t mock_pins[128];
+int mock_analog[16];
+unsigned long mock_micros = 0UL;
+void (*mock_advance)(unsigned long us) = NULL;
+void (*mock_write)(int pin, int level) = NULL;
+HardwareSerial Serial;
+SDClass SD;
+
+void delayMicroseconds(unsigned int us) {
+  mock_micros += us;
+  if(mock_advance)
+    mock_advance(us);
+}
+void delay(unsigned long ms) {
+  delayMicroseconds(ms * 1000UL);
+}
+
+#include "printr.ino"
+
+namespace host {
+
+  typedef void (*StepHook)(char axis, unsigned long us);
+
+  StepHook stepHook = NULL; // step pulses, with the time of their tick
+  int failures = 0;
+
+  // step pins of the sketch steppers
+  char axisOfPin(int pin) {
+    switch(pin){
+      case 28: return 'x';
+      case 8:  return 'y';
+      case 22: return 'z';
+      case 2:  return 'e';
+      default: return 0;
+    }
+  }
+  void onWrite(int pin, int level) {
+    char axis = axisOfPin(pin);
+    if(stepHook && axis && level == HIGH)
+      stepHook(axis, ticker::time());
+  }
+
+  /**
+   * Steps of a run, with their times from the first one
+   */
+  struct Trace {
+    static const unsigned long SIZE = 100000UL;
+    char axis[SIZE];
+    unsigned long time[SIZE];
+    unsigned long n, first;
+
+    void clear() {
+      n = 0UL;
+      first = ~0UL;
+    }
+    void record(char a, unsigned long us) {
+      if(n == SIZE)
+        return;
+      if(first == ~0UL)
+        first = us;
+      axis[n] = a;
+      time[n] = us - first;
+      ++n;
+    }
+    bool operator==(const Trace &t) const {
+      if(n != t.n)
+        return false;
+      for(unsigned long i = 0; i < n; ++i){
+        if(axis[i] != t.axis[i] || time[i] != t.time[i])
+          return false;
+      }
+      return true;
+    }
+  };
+  Trace *tracing = NULL;
+
+  void traceStep(char axis, unsigned long us) {
+    if(tracing)
+      tracing->record(axis, us);
+  }
+  // record the steps into t (NULL to stop)
+  void trace(Trace *t) {
+    tracing = t;
+    stepHook = traceStep;
+  }
+
+  void begin() {
+    mock_advance = ticker::advance;
+    mock_write = onWrite;
+    setup();
+  }
+
+  // command line, read by the next loops (see readCommands())
+  void command(const char *line) {
+    Serial.in.append(line);
+    Serial.in.push('\n');
+  }
+
+  // gcode text, processed as a file (see processFile())
+  void gcode(const char *text, float scale = 1.0f) {
+    File &f = sdcard::currentFile();
+    f = File();
+    f.data.append(text);
+    f.open = true;
+    processFile(f, true, scale);
+  }
+
+  // one iteration of the main loop, taking cost us
+  void step(unsigned long cost = 100UL) {
+    loop();
+    mock_micros += cost;
+    ticker::advance(cost);
+  }
+
+  // whether commands, a file or moves are left
+  bool isBusy() {
+    return Serial.available() || sdcard::currentFile() || !idle()
+        || locZ.hasTarget() || !events::isEmpty();
+  }
+
+  // main loops until the machine is done (at most n), whether it got there
+  bool run(long n, unsigned long cost = 100UL) {
+    for(; n > 0 && isBusy(); --n)
+      step(cost);
+    return !isBusy();
+  }
+
+  // output of the sketch since the last call
+  const char *output() {
+    static MockString last;
+    last.clear();
+    last.append(Serial.out.c_str());
+    Serial.out.clear();
+    return last.c_str();
+  }
+
+  void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if(!ok)
+      ++failures;
+  }
+  int result() {
+    return failures ? 1 : 0;
+  }
+
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+/**
+ * Arduino core for the host build (see ../host.h): the pins are an array,
+ * time is virtual (advanced by the delays and the test loops), and Serial
+ * reads and writes to memory.
+ * The C library is declared by hand, since the core macros (min, max, abs,
+ * round) clash with the standard C++ headers, as on the boards.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+extern "C" {
+  long labs(long); long atol(const char *); double atof(const char *);
+  int snprintf(char *, size_t, const char *, ...);
+  int vsnprintf(char *, size_t, const char *, __builtin_va_list);
+  int putchar(int); int printf(const char *, ...);
+  double sqrt(double); float sqrtf(float); double floor(double); double ceil(double); double fabs(double);
+  double cos(double); double sin(double); double acos(double); double atan2(double, double);
+  double fmod(double, double); double pow(double, double); double exp(double);
+  void *memset(void *, int, size_t); void *memcpy(void *, const void *, size_t);
+  size_t strlen(const char *); void exit(int);
+}
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define INPUT 0
+#define SS 53
+#define DEC 10
+#define F_CPU 16000000UL
+#define PI 3.1415926535897932384626433832795
+#define HALF_PI 1.5707963267948966192313216916398
+
+#define B00 0
+#define B01 1
+#define B10 2
+#define B11 3
+#define B000 0
+#define B001 1
+#define B010 2
+#define B011 3
+#define B100 4
+#define B101 5
+#define B110 6
+#define B111 7
+
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define abs(x) ((x)>0?(x):-(x))
+#define round(x) ((x)>=0?(long)((x)+0.5):(long)((x)-0.5))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+#define sq(x) ((x)*(x))
+
+#define PROGMEM
+#define memcpy_P(d, s, n) memcpy(d, s, n)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+
+// --- pins and time -----------------------------------------------------------
+extern uint8_t mock_pins[128];
+extern int mock_analog[16]; // analog inputs (e.g. the endstops)
+extern unsigned long mock_micros;
+extern void (*mock_advance)(unsigned long us); // virtual time of the delays
+extern void (*mock_write)(int pin, int level);  // pin changes
+
+inline void pinMode(int, int) {}
+inline void digitalWrite(int p, int v) {
+  if(mock_write && mock_pins[p] != v)
+    mock_write(p, v);
+  mock_pins[p] = v;
+}
+inline int digitalRead(int p) { return mock_pins[p]; }
+inline int analogRead(int p) { return mock_analog[p & 15]; }
+inline unsigned long micros() { return mock_micros; }
+inline unsigned long millis() { return mock_micros / 1000UL; }
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// --- serial ------------------------------------------------------------------
+struct MockString {
+  char *buf;
+  size_t n, cap;
+  MockString() : buf(0), n(0), cap(0) {}
+  void push(char c) {
+    if(n + 2 > cap){
+      size_t nc = cap ? cap * 2 : 256;
+      char *b = new char[nc];
+      for(size_t i = 0; i < n; ++i) b[i] = buf[i];
+      delete[] buf;
+      buf = b;
+      cap = nc;
+    }
+    buf[n++] = c;
+    buf[n] = 0;
+  }
+  void append(const char *s) { while(*s) push(*s++); }
+  void clear() { n = 0; if(buf) buf[0] = 0; }
+  const char *c_str() const { return buf ? buf : ""; }
+  size_t size() const { return n; }
+  char operator[](size_t i) const { return buf[i]; }
+};
+
+class Print {
+public:
+  virtual size_t write(uint8_t c) { return 0; }
+  size_t print(const char *s) { size_t k = 0; while(*s){ write(*s++); ++k; } return k; }
+  size_t print(char c) { write(c); return 1; }
+  size_t print(long v, int b = DEC) { char s[32]; snprintf(s, 32, "%ld", v); return print(s); }
+  size_t print(unsigned long v, int b = DEC) { char s[32]; snprintf(s, 32, "%lu", v); return print(s); }
+  size_t print(int v, int b = DEC) { return print(long(v), b); }
+  size_t print(unsigned int v, int b = DEC) { return print((unsigned long)v, b); }
+  size_t print(unsigned char v, int b = DEC) { return print((unsigned long)v, b); }
+  size_t print(double v, int d = 2) { char s[64]; snprintf(s, 64, "%.*f", d, v); return print(s); }
+  size_t println() { return print("\n"); }
+  template <typename T> size_t println(T v) { size_t n = print(v); println(); return n; }
+  template <typename T> size_t println(T v, int b) { size_t n = print(v, b); println(); return n; }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+  float parseFloat() {
+    MockString s;
+    int c;
+    while((c = peek()) >= 0 && (c == '-' || c == '.' || (c >= '0' && c <= '9')))
+      s.push(char(read()));
+    return s.size() ? float(atof(s.c_str())) : 0.0f;
+  }
+  void flush() {}
+};
+
+class HardwareSerial : public Stream {
+public:
+  MockString in, out; // input to read, output written
+  size_t pos;
+  HardwareSerial() : pos(0) {}
+  void begin(long) {}
+  size_t write(uint8_t c) override { out.push(char(c)); return 1; }
+  int available() override { return int(in.size() - pos); }
+  int read() override { return pos < in.size() ? (unsigned char)in[pos++] : -1; }
+  int peek() override { return pos < in.size() ? (unsigned char)in[pos] : -1; }
+};
+extern HardwareSerial Serial;
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Arduino.h"
+
+// file in memory (see host::gcode())
+class File : public Stream {
+public:
+  MockString data;
+  size_t pos;
+  bool open;
+  File() : pos(0), open(false) {}
+  operator bool() const { return open; }
+  const char *name() const { return "host.gcode"; }
+  unsigned long size() const { return data.size(); }
+  bool isDirectory() const { return false; }
+  void close() { open = false; }
+  File openNextFile() { return File(); }
+  void rewindDirectory() {}
+  int available() override { return open ? int(data.size() - pos) : 0; }
+  int read() override { return pos < data.size() ? (unsigned char)data[pos++] : -1; }
+  int peek() override { return pos < data.size() ? (unsigned char)data[pos] : -1; }
+};
+
+class SDClass {
+public:
+  bool begin() { return true; }
+  File open(const char *) { return File(); }
+};
+extern SDClass SD;
@@ -0,0 +1,62 @@
+/**
+ * Pressure advance of the extrusion (s e la <ms>, see Locator::setAdvance):
+ * the extruder runs ahead of the same line without advance while it speeds
+ * up, by its distance at the current speed over the advance time, comes
+ * back while it slows down, and ends on the same extruded distance.
+ */
+#include "host.h"
+
+static const unsigned long ADVANCE = 200UL; // ms
+static const char *PATH =
+  "G21\n"
+  "G91\n"
+  "G1 X150 E20 F6000\n";
+
+struct Run {
+  static const long SIZE = 200000L;
+  long e[SIZE];   // extruder position per tick, from the start
+  long x[SIZE];
+  long n;
+};
+Run plain, advanced;
+
+void extrude(Run &r, unsigned long advance) {
+  host::command(advance ? "s e la 200" : "s e la 0");
+  host::run(1000L);
+  long e0 = stpE0.value(), x0 = stpX.value();
+  host::gcode(PATH);
+  for(r.n = 0; r.n < Run::SIZE && host::isBusy(); ++r.n){
+    host::step(ticker::TICK_TIME);
+    r.e[r.n] = stpE0.value() - e0;
+    r.x[r.n] = std::abs(stpX.value() - x0);
+  }
+}
+
+int main() {
+  host::begin();
+  stpX.resetBounds();
+  stpE0.resetBounds();
+  extrude(plain, 0UL);
+  extrude(advanced, ADVANCE);
+
+  long n = std::min(plain.n, advanced.n);
+  long x = plain.x[plain.n - 1], e = plain.e[plain.n - 1];
+  long lead = 0L, stop = 0L, v_max = 0L;
+  for(long i = 0; i < n; ++i){
+    long d = advanced.e[i] - plain.e[i];
+    lead = std::max(lead, d);
+    if(plain.x[i] == x && (!i || plain.x[i - 1] != x))
+      stop = d; // lead when the line stops
+    if(i >= 100L) // x speed over 100 ticks (steps/s)
+      v_max = std::max(v_max, (plain.x[i] - plain.x[i - 100L]) * ticker::RATE / 100L);
+  }
+  // distance of the extruder at the cruise speed over the advance time
+  float expected = float(v_max) * float(e) / float(x) * float(ADVANCE) / 1000.0f;
+  printf("%ld and %ld ticks, e %ld and %ld, lead %ld (expected %.0f), %ld at the stop\n",
+         plain.n, advanced.n, e, advanced.e[advanced.n - 1], lead, expected, stop);
+  host::check(e > 0L, "extrudes");
+  host::check(advanced.e[advanced.n - 1] == e, "same extruded distance");
+  host::check(std::abs(float(lead) - expected) <= 0.25f * expected, "lead of the advance time");
+  host::check(lead > 0L && std::abs(stop) <= lead / 4L, "back while slowing down");
+  return host::result();
+}
@@ -0,0 +1,114 @@
+/**
+ * G2/G3 arcs (see CommandReader::startArc): the arcs are cut into lines
+ * on the board, stay within a few steps of their circle, and end exactly
+ * on their end point, z included along a helix. A half circle given by
+ * its radius is a valid arc, though its rounded end points may be a bit
+ * further apart than its diameter. Arcs that would pass a soft limit
+ * between their end points are rejected before moving.
+ */
+#include "host.h"
+
+static const float XY_STEP = 4.0f; // 1/4 microsteps at speed (see setup())
+
+// gcode position (mm) => steps (see gcode::convertToUnit)
+long steps(float mm) {
+  return long(std::round(mm * 5000.0f / 56.0f));
+}
+
+// whether the output of the sketch has a message
+bool says(const char *out, const char *msg) {
+  for(; *out; ++out){
+    const char *a = out, *b = msg;
+    while(*b && *a == *b){ ++a; ++b; }
+    if(!*b) return true;
+  }
+  return false;
+}
+
+// runs a path, whether it ends on (x, y, z) without error, and if it has
+// a center (cx, cy), within a few steps of its circle from the start point
+bool arc(const char *path, float x, float y, float z = 0.0f,
+         bool circle = false, float cx = 0.0f, float cy = 0.0f) {
+  vec2 c(steps(cx), steps(cy)), p = locXY.value() - c;
+  float r = sqrt(float(p.x) * float(p.x) + float(p.y) * float(p.y)), dev = 0.0f;
+  host::output();
+  host::gcode(path);
+  for(long n = 0; n < 2000000L && host::isBusy(); ++n){
+    host::step();
+    p = locXY.value() - c;
+    float d = sqrt(float(p.x) * float(p.x) + float(p.y) * float(p.y)) - r;
+    if(circle)
+      dev = std::max(dev, d < 0.0f ? -d : d);
+  }
+  bool valid = !says(host::output(), "Invalid arc!");
+  vec2 xy = locXY.value();
+  long zz = stpZ.value();
+  printf("x %ld (%ld), y %ld (%ld), z %ld (%ld), %.1f from the circle%s%s\n",
+         xy.x, steps(x), xy.y, steps(y), zz, steps(z), dev,
+         host::isBusy() ? ", still busy" : "", valid ? "" : ", invalid arc");
+  // lines within 2 steps of the circle (see arcTolerance), and x and y
+  // within a step of the lines, in the coarsest gear
+  return !host::isBusy() && valid && xy == vec2(steps(x), steps(y))
+      && zz == steps(z) && dev <= 2.0f + XY_STEP;
+}
+
+// runs an arc with a bound on x, whether it is rejected without moving,
+// the error then holds the machine until a reset
+bool rejected(const char *path, long xmax) {
+  stpX.setMaxValue(xmax);
+  vec2 p = locXY.value();
+  host::output();
+  host::gcode(path);
+  bool out = false;
+  for(long n = 0; n < 100000L && !out; ++n){
+    host::step();
+    out = says(host::output(), "Target out of bounds!");
+  }
+  host::run(10000L);
+  printf("x %ld, y %ld%s\n", locXY.value().x, locXY.value().y, out ? ", rejected" : "");
+  bool still = locXY.value() == p;
+  host::command("r");
+  sdcard::currentFile().close();
+  host::run(1000L);
+  stpX.resetBounds();
+  return out && still;
+}
+
+int main() {
+  host::begin();
+  stpX.resetBounds();
+  stpY.resetBounds();
+  stpZ.resetBounds();
+  host::check(arc("G21\nG90\nG1 X-10 Y0 F3000\nG3 X10 Y0 R-10\n", 10.0f, 0.0f),
+              "half circle by its radius");
+  host::check(arc("G2 X-10 Y0 R10\n", -10.0f, 0.0f), "half circle back");
+
+  // around the origin
+  host::check(arc("G3 X0 Y-10 I10 J0\n", 0.0f, -10.0f, 0.0f, true),
+              "quarter counterclockwise");
+  host::check(arc("G2 X-10 Y0 I0 J10\n", -10.0f, 0.0f, 0.0f, true),
+              "quarter clockwise");
+  host::check(arc("G2 X0 Y10 R10\n", 0.0f, 10.0f, 0.0f, true),
+              "short arc by its radius");
+  host::check(arc("G2 X10 Y0 R-10\n", 10.0f, 0.0f, 0.0f, true, 10.0f, 10.0f),
+              "long arc by its radius");
+  host::check(arc("G3 X10 Y0 I-10 J0\n", 10.0f, 0.0f, 0.0f, true),
+              "full circle");
+  host::check(arc("G2 X10 Y0 I-10 J0 Z5\n", 10.0f, 0.0f, 5.0f, true),
+              "helix");
+
+  // the right side of this half circle passes x = 20, and the one of
+  // the next arc its x bound by a fraction of a step (which is still
+  // past it): both are rejected before moving
+  host::check(rejected("G3 X10 Y20 I0 J10\n", steps(15.0f)), "arc past a soft limit");
+  host::check(arc("G1 X19 Y10\n", 19.0f, 10.0f, 5.0f), "start of the next arc");
+  long cx = steps(19.0f) + steps(1.0f), cy = 2L * steps(10.0f);
+  float dx = float(steps(19.0f) - cx), dy = float(steps(10.0f) - cy);
+  long right = long(float(cx) + sqrt(dx * dx + dy * dy));
+  host::check(rejected("G3 X21 Y30 I1 J10\n", right), "arc past a soft limit within a step");
+  stpX.setMaxValue(right + 1L);
+  host::check(arc("G3 X21 Y30 I1 J10\n", 21.0f, 30.0f, 5.0f, true, 20.0f, 20.0f),
+              "arc up to a soft limit");
+  stpX.resetBounds();
+  return host::result();
+}
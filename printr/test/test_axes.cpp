@@ -0,0 +1,61 @@
+/**
+ * Views past the axes of the tick (see axes::attach): the benchmarks run
+ * temporary ones on the free entries, only when the machine is idle, and
+ * give them back. Past MAX_AXES, a view is an error, and has an entry of
+ * its own, which the tick never steps, instead of the one of the last axis.
+ */
+#include "host.h"
+
+static const int PIN = 48; // unused (see bench.h)
+
+// whether the output of the sketch has a message
+bool says(const char *out, const char *msg) {
+  for(; *out; ++out){
+    const char *a = out, *b = msg;
+    while(*b && *a == *b){ ++a; ++b; }
+    if(!*b) return true;
+  }
+  return false;
+}
+
+int main() {
+  host::begin();
+  stpX.resetBounds();
+  uint8_t n = axes::numAxes;
+
+  // benchmarks, refused while x moves
+  host::output();
+  host::command("x 2000");
+  host::run(100L);
+  host::command("b m");
+  host::run(100L);
+  bool refused = says(host::output(), "Cannot benchmark while moving");
+  host::check(refused && stpX.currentSpeed() > 0L, "no benchmark while moving");
+  host::command("x 0");
+  host::run(100000L);
+  host::command("b m");
+  host::run(10L);
+  const char *out = host::output();
+  host::check(says(out, "line update") && axes::numAxes == n && !axes::changed,
+              "benchmark when idle, its axes given back");
+
+  Stepper *last = NULL;
+  while(axes::numAxes < axes::MAX_AXES)
+    last = new Stepper(PIN, PIN, PIN, PIN, PIN, PIN, 'a');
+  host::check(error == ERR_NONE, "axes up to MAX_AXES");
+
+  Stepper extra(PIN, PIN, PIN, PIN, PIN, PIN, 'b');
+  host::check(error == ERR_AXIS_OVERFLOW, "one more is an error");
+  error = ERR_NONE;
+  long before = last->value();
+  extra.resetPosition(100L);
+  extra.enable();
+  extra.moveToSpeed(1000L);
+  for(long n = 0; n < 1000L; ++n)
+    ticker::advance(ticker::TICK_TIME);
+  printf("extra %ld (%ld steps/s), last axis %ld (%ld steps/s)\n",
+         extra.value(), extra.currentSpeed(), last->value(), last->currentSpeed());
+  host::check(last->value() == before && !last->currentSpeed(), "the last axis is left alone");
+  host::check(extra.value() == 100L, "the extra view is not stepped");
+  return host::result();
+}
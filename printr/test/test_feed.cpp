@@ -0,0 +1,42 @@
+/**
+ * Feedrate of the gcode moves (F, see CommandReader::feedrate): the path
+ * speed of the moves, in distance per minute whatever the scale of the
+ * positions, which scales the distances only. G0 rapids ignore it and
+ * travel at the best speed of the planner.
+ */
+#include "host.h"
+
+static const char *PATH =
+  "G21\n"
+  "G91\n"
+  "G1 X100 F600\n";
+
+// fastest x speed of a path (steps/s)
+long cruise(const char *path, float scale = 1.0f) {
+  host::gcode(path, scale);
+  long v = 0L;
+  for(long n = 0; n < 1000000L && host::isBusy(); ++n){
+    host::step(ticker::TICK_TIME);
+    v = std::max(v, std::abs(stpX.currentSpeed()));
+  }
+  return v;
+}
+
+int main() {
+  host::begin();
+  stpX.resetBounds();
+  // 600 mm/min = 10 mm/s (see gcode::convertToSpeed)
+  long expected = long(std::round(10.0f * 5000.0f / 56.0f));
+  long v1 = cruise(PATH, 1.0f), v2 = cruise(PATH, 2.0f);
+  printf("cruise %ld and %ld steps/s (expected %ld)\n", v1, v2, expected);
+  host::check(std::abs(v1 - expected) <= 1L, "feedrate of the path");
+  host::check(v2 == v1, "feedrate not scaled");
+
+  // a rapid after a slow line
+  host::command("s m fb 2000");
+  host::run(1000L);
+  long v0 = cruise("G21\nG91\nG1 X10 F300\nG0 X-100\n");
+  printf("rapid at %ld steps/s (best 2000)\n", v0);
+  host::check(v0 == 2000L, "rapid at the best speed");
+  return host::result();
+}
@@ -0,0 +1,67 @@
+/**
+ * XY lines (see Locator): both axes end on the exact target, and the path
+ * stays within a step of the coarsest gear of x and y (1/4, see setup())
+ * of the line on the way, for any ratio, alone or along a queued path.
+ */
+#include "host.h"
+
+static const float MAX_DEVIATION = 4.0f; // 1/16 microsteps
+
+// distance of p from the line through a and b
+float deviation(const vec2 &a, const vec2 &b, const vec2 &p) {
+  float dx = float(b.x - a.x), dy = float(b.y - a.y);
+  float px = float(p.x - a.x), py = float(p.y - a.y);
+  return std::abs(dx * py - dy * px) / sqrt(dx * dx + dy * dy);
+}
+
+// runs the moves tick by tick, the worst deviation from the segment a-b
+float follow(const vec2 &a, const vec2 &b) {
+  float worst = 0.0f;
+  for(long n = 0; n < 1000000L && host::isBusy(); ++n){
+    host::step(ticker::TICK_TIME);
+    worst = std::max(worst, deviation(a, b, locXY.value()));
+  }
+  return worst;
+}
+
+int main() {
+  host::begin();
+  stpX.resetBounds();
+  stpY.resetBounds();
+
+  // lines alone
+  static const long lines[][2] = {
+    { 4000L, 4000L }, { 7000L, 3000L }, { -3000L, 7001L }, { 20000L, 7000L },
+    { 16L, -5000L }, { -4096L, -16L }, { 9999L, 1L }, { 333L, 334L },
+  };
+  float worst = 0.0f;
+  bool onTarget = true;
+  for(unsigned i = 0; i < sizeof(lines) / sizeof(lines[0]); ++i){
+    vec2 from = locXY.value();
+    vec2 trg = from + vec2(lines[i][0], lines[i][1]);
+    locXY.setTarget(trg);
+    float d = follow(from, trg);
+    printf("line %6ld %6ld: deviation %.1f\n", lines[i][0], lines[i][1], d);
+    worst = std::max(worst, d);
+    onTarget = onTarget && locXY.value() == trg;
+  }
+  host::check(onTarget, "lines end on target");
+  host::check(worst <= MAX_DEVIATION, "lines stay within a step");
+
+  // queued path, through its corners (a straight one to check the deviation),
+  // longer than the lookahead
+  vec2 from = locXY.value(), trg = from + vec2(2000L * 12L, 700L * 12L);
+  float d = 0.0f;
+  for(long k = 1; k <= 12; ++k){
+    while(locXY.isQueueFull()){
+      host::step(ticker::TICK_TIME);
+      d = std::max(d, deviation(from, trg, locXY.value()));
+    }
+    locXY.queueTarget(from + vec2(2000L * k, 700L * k));
+  }
+  d = std::max(d, follow(from, trg));
+  printf("path: deviation %.1f\n", d);
+  host::check(locXY.value() == trg, "path ends on target");
+  host::check(d <= MAX_DEVIATION, "path stays within a step");
+  return host::result();
+}
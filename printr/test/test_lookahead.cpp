@@ -0,0 +1,62 @@
+/**
+ * Lookahead of the queued targets (see Locator::queueTarget): a path with
+ * corners goes through them without stopping, and ends sooner than with
+ * a stop at every corner ("s m jd 0"). The planned time of the path (see
+ * Locator::plannedTime) is that of the tick, both ways.
+ */
+#include "host.h"
+
+static const long CORNERS[][2] = {
+  { 4000L, 1500L }, { 8000L, 0L }, { 12000L, 1500L }, { 16000L, 0L },
+  { 16000L, 5000L }, { 12000L, 6500L }, { 8000L, 5000L }, { 0L, 5000L },
+};
+static const int NUM_CORNERS = sizeof(CORNERS) / sizeof(CORNERS[0]);
+
+// runs the path, its time (us) up to its last stop, with its planned time and its stops
+unsigned long path(unsigned long deviation, unsigned long &planned, int &stops) {
+  locXY.setDeviation(deviation);
+  vec2 from = locXY.value();
+  for(int i = 0; i < NUM_CORNERS; ++i)
+    locXY.queueTarget(from + vec2(CORNERS[i][0], CORNERS[i][1]));
+  planned = locXY.plannedTime();
+  unsigned long start = ticker::time();
+  unsigned long t = 0UL;
+  bool moving = false;
+  stops = 0;
+  for(long n = 0; n < 1000000L && host::isBusy(); ++n){
+    host::step(ticker::TICK_TIME);
+    bool m = stpX.currentSpeed() || stpY.currentSpeed();
+    if(moving && !m){
+      t = ticker::time() - start;
+      ++stops;
+    }
+    moving = m;
+  }
+  vec2 end = from + vec2(CORNERS[NUM_CORNERS - 1][0], CORNERS[NUM_CORNERS - 1][1]);
+  printf("deviation %lu: %lu us (planned %lu), %d stops, end %ld %ld\n",
+         deviation, t, planned, stops, locXY.value().x - end.x, locXY.value().y - end.y);
+  host::check(locXY.value() == end, "path ends on target");
+  return t;
+}
+
+// within 1% of each other
+bool near(unsigned long a, unsigned long b) {
+  unsigned long d = a > b ? a - b : b - a;
+  return 100UL * d <= b;
+}
+
+int main() {
+  host::begin();
+  stpX.resetBounds();
+  stpY.resetBounds();
+  unsigned long planned0, planned1;
+  int stops0, stops1;
+  unsigned long t0 = path(0UL, planned0, stops0);
+  unsigned long t1 = path(Locator::DEFAULT_DEVIATION * 16UL, planned1, stops1);
+  host::check(stops0 == NUM_CORNERS, "a stop at every corner");
+  host::check(stops1 == 1, "through the corners with the lookahead");
+  host::check(t1 < t0, "sooner with the lookahead");
+  host::check(near(planned0, t0), "planned time with stops");
+  host::check(near(planned1, t1), "planned time through the corners");
+  return host::result();
+}
@@ -0,0 +1,39 @@
+/**
+ * Pin traits of the ATmega2560 (see pins.h): port register and bit of the
+ * stepper pins, checked at compile time against the Mega pinout. Pins past
+ * the table write no bit, and are an error when they are set up.
+ * Only the traits are used: the port writes need the board.
+ */
+#include "Arduino.h"
+#define __AVR_ATmega2560__
+#include "pins.h"
+
+HardwareSerial Serial; // of the errors (see host.h)
+
+struct Expected {
+  uint8_t pin;
+  uint16_t port;
+  uint8_t bit;
+};
+
+constexpr bool matches(const Expected &e) {
+  return pins::address(e.pin) == e.port && pins::mask(e.pin) == 1 << e.bit;
+}
+
+// step pins of x, y, z and e (see printr.ino), first and last analog pins
+static_assert(matches({ 28, 0x22,  6 }), "x step on PA6");
+static_assert(matches({ 8,  0x102, 5 }), "y step on PH5");
+static_assert(matches({ 22, 0x22,  0 }), "z step on PA0");
+static_assert(matches({ 2,  0x2E,  4 }), "e step on PE4");
+static_assert(matches({ 54, 0x31,  0 }), "A0 on PF0");
+static_assert(matches({ 69, 0x108, 7 }), "A15 on PK7");
+static_assert(!pins::isValid(70) && pins::mask(70) == 0, "no pin past A15");
+
+int main() {
+  Pin p(28);
+  printf("pin %u: port 0x%x, mask 0x%x\n", p.number(), unsigned((uintptr_t)p.port()), p.mask());
+  Pin q(70);
+  q.output();
+  printf("pin %u: port 0x%x, mask 0x%x, error %d\n", q.number(), unsigned((uintptr_t)q.port()), q.mask(), error);
+  return p.mask() == 0x40 && error == ERR_INVALID_PIN ? 0 : 1;
+}
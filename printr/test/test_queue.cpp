@@ -0,0 +1,121 @@
+/**
+ * The step queue ("s q 1", see events.h) plans the same tick as the
+ * interrupt: the same moves give the same steps at the same times
+ * from their first one, with and without the queue, and the queue
+ * does not run dry. Endstops set their bound where the motor is, behind
+ * the planner with the queue.
+ * As in test_tick, the xy lines and a gcode path are compared whole, and
+ * the axes run on their own for the first WINDOW us of each move.
+ */
+#include "host.h"
+
+static const unsigned long WINDOW = 300000UL;
+
+host::Trace direct, queued;
+
+static const char *PATH =
+  "G21\n"
+  "G90\n"
+  "G1 X10 Y5 F3000\n"
+  "G1 X20 Y5 E2\n"
+  "G1 X5 Y15 E4 F1200\n"
+  "G1 X0 Y0\n";
+
+// not host::isBusy(): the Elevator may be off, its target left behind
+void finish() {
+  for(long n = 0; n < 1000000L && (Serial.available() || !idle() || !events::isEmpty()); ++n)
+    host::step();
+}
+
+void moves(host::Trace &t, bool queue) {
+  host::command(queue ? "s q 1" : "s q 0");
+  finish();
+  for(int i = 0; i < NUM_STEPPERS; ++i)
+    steppers[i]->resetPosition(0L);
+  locZ.resetZ(0L);
+  static const char *lines[] = { "m 1000 300", "m -400 2000", "M 0 0", NULL };
+  static const char *axes[] = {
+    "x 1666", "x -1000", "y 2500", "y -714", "z 1250", "z -1666", "e 833", "e -2500", NULL
+  };
+  host::trace(&t);
+  for(const char **c = lines; *c; ++c){
+    t.first = ~0UL; // times from the first step of each move
+    host::command(*c);
+    host::run(1000000L);
+  }
+  t.first = ~0UL;
+  host::gcode(PATH);
+  host::run(1000000L);
+  locXY.disable();
+  locZ.disable();
+  for(const char **c = axes; *c; ++c){
+    unsigned long start = t.n;
+    t.first = ~0UL;
+    host::command(*c);
+    while(t.first == ~0UL || ticker::time() - t.first <= WINDOW)
+      host::step();
+    // the steps of the window only
+    while(t.n > start && t.time[t.n - 1] > WINDOW)
+      --t.n;
+    // stop (not traced)
+    host::trace(NULL);
+    char stop[] = "? 0";
+    stop[0] = (*c)[0];
+    host::command(stop);
+    finish();
+    host::trace(&t);
+  }
+  locXY.enable();
+  locZ.resetZ(stpZ.value()); // the Elevator keeps z where it is
+  locZ.enable();
+  host::trace(NULL);
+}
+
+// x towards its min endstop, hit at the same time in both modes, or stopped
+// by a reset (bound and position from the start)
+void stop(bool queue, bool endstop, long &bound, long &x) {
+  host::command(queue ? "s q 1" : "s q 0");
+  host::run(1000L);
+  stpX.resetBounds();
+  locXY.disable(); // x on its own
+  long x0 = stpX.value();
+  host::command("x -3000");
+  for(long k = 0; k < 5000L; ++k)
+    host::step();
+  if(endstop)
+    mock_analog[SWITCH_X_MIN] = 1000;
+  else
+    host::command("r"); // resetAll(), as errors do
+  host::step();
+  mock_analog[SWITCH_X_MIN] = 0;
+  host::run(1000000L);
+  bound = stpX.minValue() - x0;
+  x = stpX.value() - x0;
+  stpX.resetBounds();
+  locXY.enable();
+}
+
+int main() {
+  host::begin();
+  for(int i = 0; i < NUM_STEPPERS; ++i)
+    steppers[i]->resetBounds();
+  direct.clear();
+  queued.clear();
+  moves(direct, false);
+  moves(queued, true);
+  printf("%lu and %lu steps, %lu underruns\n", direct.n, queued.n, events::underruns);
+  host::check(direct.n > 1000UL, "moves step");
+  host::check(direct == queued, "same step times with the queue");
+  host::check(events::underruns == 0UL, "no queue underrun");
+
+  long bound0, x0, bound1, x1;
+  stop(false, true, bound0, x0);
+  stop(true, true, bound1, x1);
+  printf("endstop at %ld (x %ld) and %ld (x %ld)\n", bound0, x0, bound1, x1);
+  host::check(bound1 == bound0 && x1 == x0 && x1 == bound1, "endstop bound at the motor");
+  stop(false, false, bound0, x0);
+  stop(true, false, bound1, x1);
+  printf("reset at x %ld and %ld\n", x0, x1);
+  host::check(x1 == x0, "reset at the motor");
+  return host::result();
+}
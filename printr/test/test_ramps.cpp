@@ -0,0 +1,69 @@
+/**
+ * The closed forms of Stepper::rampBetweenSpeeds() against the ramps
+ * that the step tick actually runs (Stepper::nextSpeed() every tick):
+ * same duration within a tick, same distance within a step,
+ * with constant accelerations and S-curves, across direction changes.
+ */
+#include "host.h"
+
+static const int PIN = 48; // unused (see bench.h)
+Stepper stp(PIN, PIN, PIN, PIN, PIN, PIN, 'b');
+
+struct Case {
+  long v_c, v_t; // steps/s
+  unsigned long accel, jerk;
+};
+
+// ramp of the tick from v_c to v_t
+Stepper::Ramp simulate(const Case &c) {
+  stp.reset();
+  stp.enable();
+  stp.setAcceleration(c.accel);
+  stp.setJerk(c.jerk);
+  stp.moveToSpeed(c.v_c);
+  for(long n = 0; n < 1000000L && stp.currentSpeed() != c.v_c; ++n)
+    ticker::advance(ticker::TICK_TIME);
+  long s0 = stp.value();
+  unsigned long t0 = ticker::time();
+  stp.moveToSpeed(c.v_t);
+  for(long n = 0; n < 1000000L && stp.currentSpeed() != c.v_t; ++n)
+    ticker::advance(ticker::TICK_TIME);
+  Stepper::Ramp r = { ticker::time() - t0, stp.value() - s0 };
+  return r;
+}
+
+int main() {
+  host::begin();
+  stp.setStartSpeed(200UL);
+  static const Case cases[] = {
+    { 0L, 3000L, 20000UL, 0UL },       // from rest
+    { 3000L, 0L, 20000UL, 0UL },       // to rest
+    { 500L, 4000L, 50000UL, 0UL },     // between two unsafe speeds
+    { 4000L, 1200L, 50000UL, 0UL },
+    { 3000L, -3000L, 20000UL, 0UL },   // reversal
+    { -2500L, 100L, 30000UL, 0UL },    // reversal to a safe speed
+    { 150L, 3000L, 20000UL, 0UL },     // direct change to the start speed first
+    { 0L, 3000L, 20000UL, 400000UL },  // S-curves
+    { 3000L, 500L, 20000UL, 2000000UL },
+    { 3000L, -3000L, 20000UL, 400000UL },
+    { 0L, 400L, 20000UL, 100000UL },   // short S-curve, below the full acceleration
+  };
+  bool timeOk = true, stepsOk = true;
+  for(unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i){
+    const Case &c = cases[i];
+    Stepper::Ramp sim = simulate(c);
+    Stepper::Ramp est = stp.rampBetweenSpeeds(c.v_c, c.v_t);
+    long dt = long(est.time) - long(sim.time);
+    long ds = est.steps - sim.steps;
+    printf("%6ld -> %6ld a=%lu j=%lu: %lu us %ld steps, estimated %lu us %ld steps\n",
+           c.v_c, c.v_t, c.accel, c.jerk, sim.time, sim.steps, est.time, est.steps);
+    // one tick per speed change of the ramp (up to two direct changes)
+    timeOk = timeOk && std::abs(dt) <= 3L * long(ticker::TICK_TIME);
+    // the distance of those ticks
+    long v = std::max(std::abs(c.v_c), std::abs(c.v_t));
+    stepsOk = stepsOk && std::abs(ds) <= 1L + 3L * v / ticker::RATE;
+  }
+  host::check(timeOk, "ramp durations");
+  host::check(stepsOk, "ramp distances");
+  return host::result();
+}
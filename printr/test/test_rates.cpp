@@ -0,0 +1,45 @@
+/**
+ * Step rates of the phase accumulator: any speed up to the tick rate is
+ * exact on average, where whole tick periods were off by up to 50%
+ * (e.g. 4900 steps/s ran at 5000 / 2 = 2500).
+ */
+#include "host.h"
+
+static const int PIN = 48; // unused (see bench.h)
+Stepper stp(PIN, PIN, PIN, PIN, PIN, PIN, 'b');
+
+// steps/s of the axis at the constant speed v, over a second
+double measure(long v) {
+  stp.reset();
+  stp.enable();
+  stp.setStartSpeed(5000UL); // direct changes
+  stp.moveToSpeed(v);
+  ticker::advance(10UL * ticker::TICK_TIME);
+  long s0 = stp.value();
+  unsigned long t0 = ticker::time();
+  for(long n = 0; n < ticker::RATE; ++n)
+    ticker::advance(ticker::TICK_TIME);
+  return double(stp.value() - s0) * 1e6 / double(ticker::time() - t0);
+}
+
+// rate of the whole tick period closest from below (previous tree)
+double periodRate(long v) {
+  long period = (ticker::RATE + v - 1L) / v;
+  return double(ticker::RATE / period);
+}
+
+int main() {
+  host::begin();
+  static const long speeds[] = { 1L, 37L, 1000L, 3000L, 4321L, 4900L, 5000L };
+  double worst = 0.0;
+  for(unsigned i = 0; i < sizeof(speeds) / sizeof(speeds[0]); ++i){
+    long v = speeds[i];
+    double rate = measure(v);
+    double err = std::abs(rate - double(v)); // steps over the second
+    printf("target %4ld: %7.1f steps/s (%+.3f%%), whole periods %6.1f\n",
+           v, rate, 100.0 * (rate - double(v)) / double(v), periodRate(v));
+    worst = std::max(worst, err);
+  }
+  host::check(worst <= 1.0, "step rates within a step per second");
+  return host::result();
+}
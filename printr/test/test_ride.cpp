@@ -0,0 +1,40 @@
+/**
+ * Z riding the xy lines (see Locator::setRider): the moves end on all the
+ * axes together on their targets, even when z goes further than x and y,
+ * and the next moves go on from there (z on its own included).
+ * Z on its own stops within a step of its target (see Elevator), which
+ * the next moves carry over, so z is checked within the coarsest step.
+ */
+#include "host.h"
+
+static const long Z_STEP = 8L; // 1/2 microsteps (see setup())
+
+// gcode position (mm) => steps (see gcode::convertToUnit)
+long steps(float mm) {
+  return long(std::round(mm * 5000.0f / 56.0f));
+}
+
+bool check(const char *path, float x, float y, float z) {
+  host::gcode(path);
+  bool done = host::run(2000000L);
+  vec2 xy = locXY.value();
+  long zz = stpZ.value();
+  printf("x %ld (%ld), y %ld (%ld), z %ld (%ld)%s\n", xy.x, steps(x), xy.y, steps(y),
+         zz, steps(z), done ? "" : ", still busy");
+  return done && xy == vec2(steps(x), steps(y)) && std::abs(zz - steps(z)) <= Z_STEP;
+}
+
+int main() {
+  host::begin();
+  stpX.resetBounds();
+  stpY.resetBounds();
+  stpZ.resetBounds();
+  host::check(check("G21\nG90\nG1 X10 Y0\nG1 X12 Y0 Z4\n", 12.0f, 0.0f, 4.0f),
+              "z further than x");
+  host::check(check("G1 Z6\n", 12.0f, 0.0f, 6.0f), "z on its own after riding");
+  host::check(check("G1 X20 Y0 Z26\n", 20.0f, 0.0f, 26.0f), "z much further than x");
+  host::check(check("G1 X20.05 Z60\n", 20.05f, 0.0f, 60.0f), "z along a step of x");
+  host::check(check("G1 X30 Y3 Z61\nG1 X32 Y7 Z50\nG1 X40 Y7\n", 40.0f, 7.0f, 50.0f),
+              "queued lines with z");
+  return host::result();
+}
@@ -0,0 +1,83 @@
+/**
+ * The step times do not depend on the main loop: the same moves give the
+ * same steps, at the same times from their first one, whether the loop is
+ * quiet or busy with serial commands (see ticker.h).
+ * - The axes ramp up and run on their own, with the controllers off. Their
+ *   bounds and stops are checked by the loop (see Stepper::guardBounds()),
+ *   so only the first WINDOW us of each move are compared.
+ * - The xy lines of the Locator and the z travels of the Elevator are
+ *   compared whole: they update on the events of the tick (see
+ *   axes::changed), which brakes and halts them on their targets by
+ *   itself (see Stepper::stopAt()).
+ */
+#include "host.h"
+
+static const unsigned long WINDOW = 300000UL;
+
+host::Trace quiet, busy;
+
+// runs a command until the machine is done, or for the window only
+void move(host::Trace &t, const char *command, bool traffic, bool window) {
+  unsigned long start = t.n;
+  t.first = ~0UL; // times from the first step of each move
+  host::command(command);
+  for(long k = 0; window ? t.first == ~0UL || ticker::time() - t.first <= WINDOW
+                         : host::isBusy(); ++k){
+    if(traffic && !Serial.available()){
+      host::command("s g d 0"); // a setting, read by the next loop
+      host::output();
+    }
+    host::step(traffic ? 100UL + (37UL * k) % 900UL : 100UL);
+  }
+  if(!window)
+    return;
+  // the steps of the window only
+  while(t.n > start && t.time[t.n - 1] > WINDOW)
+    --t.n;
+  // stop (not traced)
+  host::trace(NULL);
+  char stop[] = "? 0";
+  stop[0] = command[0];
+  host::command(stop);
+  for(long n = 0; n < 100000L && (Serial.available() || !idle()); ++n)
+    host::step();
+  host::trace(&t);
+}
+
+void moves(host::Trace &t, bool traffic) {
+  static const char *axes[] = {
+    "x 1666", "x -1000", "y 2500", "y -714", "z 1250", "z -1666", "e 833", "e -2500", NULL
+  };
+  static const char *lines[] = {
+    "m 1000 300", "m -400 2000", "M 0 0", "h 1250", "h -333", "H -800", NULL
+  };
+  for(int i = 0; i < NUM_STEPPERS; ++i)
+    steppers[i]->resetPosition(0L);
+  locZ.resetZ(0L);
+  host::trace(&t);
+  for(const char **c = lines; *c; ++c)
+    move(t, *c, traffic, false);
+  host::check(stpZ.value() == -800L, "z travels end on their targets");
+  locXY.disable();
+  locZ.disable();
+  for(const char **c = axes; *c; ++c)
+    move(t, *c, traffic, true);
+  locXY.enable();
+  locZ.resetZ(stpZ.value()); // the Elevator keeps z where it is
+  locZ.enable();
+  host::trace(NULL);
+}
+
+int main() {
+  host::begin();
+  quiet.clear();
+  busy.clear();
+  for(int i = 0; i < NUM_STEPPERS; ++i)
+    steppers[i]->resetBounds();
+  moves(quiet, false);
+  moves(busy, true);
+  printf("%lu and %lu steps\n", quiet.n, busy.n);
+  host::check(quiet.n > 1000UL, "moves step");
+  host::check(quiet == busy, "same step times with serial traffic");
+  return host::result();
+}
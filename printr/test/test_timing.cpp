@@ -0,0 +1,67 @@
+/**
+ * Step timing statistics ("d t", see timing.h): every step is recorded in
+ * the histogram of its axis, those of the tick, of the followers along the
+ * lines, and of the step timers (on time, from the virtual time).
+ */
+#include "host.h"
+
+host::Trace steps;
+
+// index of a stepper in the histograms
+uint8_t axisOf(const Stepper &stp) {
+  for(uint8_t i = 0; i < axes::numAxes; ++i){
+    if(axes::views[i] == &stp)
+      return i;
+  }
+  return 0;
+}
+
+unsigned long traced(char axis) {
+  unsigned long n = 0UL;
+  for(unsigned long i = 0; i < steps.n; ++i)
+    n += steps.axis[i] == axis;
+  return n;
+}
+
+int main() {
+  host::begin();
+  stpX.resetBounds();
+  stpY.resetBounds();
+  stpZ.resetBounds();
+  stpE0.resetBounds();
+
+  // x leads, then z leads and x follows, with the extrusion riding along
+  steps.clear();
+  timing::clear();
+  host::trace(&steps);
+  host::gcode("G21\nG91\nG1 X20 Y3 Z4 E2 F3000\nG1 X2 Z10 E1\n");
+  host::run(2000000L);
+  host::trace(NULL);
+  bool same = true;
+  static const char names[] = { 'x', 'y', 'z', 'e' };
+  const Stepper *stps[] = { &stpX, &stpY, &stpZ, &stpE0 };
+  for(int i = 0; i < 4; ++i){
+    unsigned long n = timing::pulses[axisOf(*stps[i])];
+    printf("%c: %lu steps, %lu recorded\n", names[i], traced(names[i]), n);
+    same = same && n == traced(names[i]) && n > 0UL;
+  }
+  host::check(same, "all the steps of the lines are recorded");
+
+  // xy on their step timers
+  timing::clear();
+  host::command("s m hw 1");
+  host::run(1000L);
+  vec2 p = locXY.value();
+  host::command("m 3000 1000");
+  host::run(2000000L);
+  host::command("s m hw 0");
+  host::run(1000L);
+  vec2 d = locXY.value() - p;
+  uint8_t x = axisOf(stpX);
+  unsigned long n = std::abs(d.x) / stpX.stepSize();
+  printf("x: %lu timer steps, %lu recorded, %u on time\n", n, timing::pulses[x],
+         timing::histogram[x][timing::NUM_BUCKETS - 1]);
+  host::check(n > 0UL && timing::pulses[x] == n, "all the timer steps are recorded");
+  host::check(timing::histogram[x][timing::NUM_BUCKETS - 1] == n, "timer steps on time");
+  return host::result();
+}
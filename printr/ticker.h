@@ -0,0 +1,202 @@
+#pragma once
+
+#include "Arduino.h"
+#include "utils.h"
+
+/**
+ * Fixed clock for the step generation.
+ *
+ * Timer2 runs in CTC mode and alternates between two phases:
+ * - the rising phase (step pulses go high),
+ * - the falling phase (step pulses go low, half a tick later).
+ * The main loop only has to plan the movements and handle I/O,
+ * which does not stretch the tick anymore.
+ * The 16-bit timers are left to the step timers of the axes (see hwstep.h).
+ *
+ * Without AVR hardware (host build), the timer is virtual
+ * and driven by ticker::advance(us).
+ *
+ * Speeds are given in steps/s and accelerations in steps/s²,
+ * they are converted into tick units here only (see units below).
+ */
+namespace ticker {
+
+  typedef void (*Handler)();
+
+  // timer2 with prescaler 8 => 2 counts per microsecond
+  static const unsigned int COUNTS_PER_US = F_CPU / 8000000UL;
+
+  // tick phases (us)
+  static const unsigned int RISE_TIME = 100; // duration of the high phase
+  static const unsigned int FALL_TIME = 100; // duration of the low phase
+  static const unsigned int TICK_TIME = RISE_TIME + FALL_TIME;
+  static const long RATE = 1000000L / TICK_TIME; // ticks per second
+  static_assert(RISE_TIME * COUNTS_PER_US <= 256 && FALL_TIME * COUNTS_PER_US <= 256,
+                "tick phases do not fit in the 8-bit timer2");
+
+  // --- units -----------------------------------------------------------------
+  // speeds are fixed-point steps/s, accumulated every tick until a full step
+  // (the remainder carries over, so any speed up to RATE is exact on average)
+  static const uint8_t SPEED_SHIFT = 8;
+  static const long STEP_PHASE = RATE << SPEED_SHIFT;
+
+  // steps/s => fixed-point speed
+  long fixedSpeed(long stepsPerSecond) {
+    return stepsPerSecond * (1L << SPEED_SHIFT);
+  }
+  // fixed-point speed => steps/s
+  long stepsPerSecond(long speed) {
+    return speed / (1L << SPEED_SHIFT);
+  }
+  // steps/s² => change of fixed-point speed per tick (at least 1)
+  long fixedAccel(unsigned long stepsPerSecond2) {
+    long dv = long((stepsPerSecond2 << SPEED_SHIFT) / RATE);
+    return dv > 0L ? dv : 1L;
+  }
+  // fixed-point speed change per tick => steps/s²
+  float accelOf(long dv) {
+    return float(dv) * float(RATE) / float(1L << SPEED_SHIFT);
+  }
+  // steps/s³ => change of the speed change per tick, per tick (0 = no jerk limit)
+  long fixedJerk(unsigned long stepsPerSecond3) {
+    if(!stepsPerSecond3) return 0L;
+    long da = long(((stepsPerSecond3 / RATE) << SPEED_SHIFT) / RATE);
+    return da > 0L ? da : 1L;
+  }
+  // jerk per tick => steps/s³
+  float jerkOf(long da) {
+    return float(da) * float(RATE) * float(RATE) / float(1L << SPEED_SHIFT);
+  }
+  // period in ticks (see speeds.h) => steps/s
+  long rateOfPeriod(unsigned long ticks) {
+    return ticks ? RATE / long(ticks) : 0L;
+  }
+
+  // state
+  Handler riseHandler = NULL;
+  Handler fallHandler = NULL;
+  bool rising = true;
+  bool running = false;
+  unsigned long elapsed = 0UL; // time of the current phase start (us)
+  unsigned long ticks = 0UL;   // number of full ticks
+  volatile uint8_t maxLatency = 0;       // timer2 counts at the interrupt entry
+  volatile unsigned long overruns = 0UL; // phases that ended past their deadline
+
+  /**
+   * Run the current phase and return the duration of the next one
+   */
+  unsigned int compare() {
+    unsigned int next;
+    if(rising){
+      elapsed += FALL_TIME; // end of the low phase
+      if(riseHandler) riseHandler();
+      next = RISE_TIME;
+    } else {
+      elapsed += RISE_TIME; // end of the high phase
+      if(fallHandler) fallHandler();
+      next = FALL_TIME;
+      ++ticks;
+    }
+    rising = !rising;
+    return next;
+  }
+
+#ifdef __AVR__
+  void begin(Handler rise, Handler fall) {
+    CriticalSection cs;
+    riseHandler = rise;
+    fallHandler = fall;
+    rising = true;
+    elapsed = ticks = 0UL;
+    TCCR2A = _BV(WGM21); // CTC on OCR2A
+    TCCR2B = _BV(CS21);  // clk/8
+    TCNT2 = 0;
+    OCR2A = FALL_TIME * COUNTS_PER_US - 1;
+    TIFR2 = _BV(OCF2A);
+    TIMSK2 |= _BV(OCIE2A);
+    running = true;
+  }
+
+  void end() {
+    CriticalSection cs;
+    TIMSK2 &= ~_BV(OCIE2A);
+    running = false;
+  }
+
+  // suspend the tick (e.g. for measurements), without resetting it
+  void pause() {
+    TIMSK2 &= ~_BV(OCIE2A);
+  }
+  void resume() {
+    if(running)
+      TIMSK2 |= _BV(OCIE2A);
+  }
+#else
+  unsigned long virtualTime = 0UL;
+  unsigned long nextEvent = 0UL;
+
+  void begin(Handler rise, Handler fall) {
+    riseHandler = rise;
+    fallHandler = fall;
+    rising = true;
+    elapsed = ticks = 0UL;
+    nextEvent = virtualTime + FALL_TIME;
+    running = true;
+  }
+
+  void end() {
+    running = false;
+  }
+
+  bool paused = false;
+  void pause() {
+    paused = true;
+  }
+  void resume() {
+    paused = false;
+  }
+
+  /**
+   * Advance the virtual clock, running all phases that are due
+   */
+  void advance(unsigned long us) {
+    unsigned long target = virtualTime + us;
+    if(paused)
+      nextEvent += us; // the timer does not count
+    while(running && !paused && nextEvent <= target){
+      virtualTime = nextEvent;
+      nextEvent += compare();
+    }
+    virtualTime = target;
+  }
+#endif
+
+  // --- getters ---------------------------------------------------------------
+  unsigned long time() {
+    CriticalSection cs;
+    return elapsed;
+  }
+  unsigned long tickCount() {
+    CriticalSection cs;
+    return ticks;
+  }
+  unsigned long tickPeriod() {
+    return TICK_TIME;
+  }
+  bool isRunning() {
+    return running;
+  }
+
+}
+
+#ifdef __AVR__
+ISR(TIMER2_COMPA_vect) {
+  uint8_t entry = TCNT2;
+  if(entry > ticker::maxLatency) ticker::maxLatency = entry;
+  uint8_t top = ticker::compare() * ticker::COUNTS_PER_US - 1;
+  OCR2A = top;
+  // the counter passed the new compare value: it wraps around at 255 first
+  if(TCNT2 >= top || (TIFR2 & _BV(OCF2A)))
+    ++ticker::overruns;
+}
+#endif
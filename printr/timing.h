@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Arduino.h"
+#include "ticker.h"
+#include "axes.h"
+
+/**
+ * Step timing statistics (see "d t").
+ *
+ * The steps of the tick are late by the fraction of tick between their
+ * ideal time and the tick they are issued at. That fraction is what is
+ * left of the phase accumulator after the step, over the speed:
+ * the histogram of each axis counts the steps by lateness, in buckets
+ * of halving width (shifts only, no division in the tick):
+ * bucket k holds lateness in [TICK_TIME / 2^(k+1), TICK_TIME / 2^k) us,
+ * the last bucket holds all the smaller ones.
+ * The followers step in the tick of their leader, as late as its step
+ * (see follow()), and the step timers at their compare match, late by
+ * the interrupt when it toggles the pin (see hwstep::compare()).
+ *
+ * The tick interrupt records its own latency and overruns (see ticker.h),
+ * both stay at zero on the host, where the same histograms are computed
+ * from the virtual time.
+ */
+namespace timing {
+
+  static const uint8_t NUM_BUCKETS = 8;
+
+  // steps of all kinds, per axis
+  unsigned long pulses[axes::NUM_ENTRIES];
+  uint16_t histogram[axes::NUM_ENTRIES][NUM_BUCKETS]; // saturates
+  uint8_t lastBucket[axes::NUM_ENTRIES]; // of the last self-timed step
+
+  inline void record(uint8_t i, uint8_t k, unsigned long n = 1UL) {
+    pulses[i] += n;
+    unsigned long h = histogram[i][k] + n;
+    histogram[i][k] = h < 0xFFFFUL ? uint16_t(h) : 0xFFFF;
+  }
+
+  /**
+   * Record a step of axis i, with the remaining phase late (< v)
+   */
+  inline void pulse(uint8_t i, long late, long v) {
+    uint8_t k = 0;
+    for(long t = v >> 1; k < NUM_BUCKETS - 1 && late < t; t >>= 1)
+      ++k;
+    lastBucket[i] = k;
+    record(i, k);
+  }
+
+  /**
+   * Record a step of follower i (see Stepper::pulse()), as late as the step
+   * of its leader in this tick, or on time without one (e.g. the advance
+   * of a rider, paid as soon as it changes)
+   */
+  inline void follow(uint8_t i, uint8_t lead) {
+    record(i, axes::pulsed[lead] ? lastBucket[lead] : NUM_BUCKETS - 1);
+  }
+
+  /**
+   * Record n steps of a step timer on axis i, late by us
+   */
+  inline void timed(uint8_t i, unsigned int us, unsigned long n = 1UL) {
+    uint8_t k = 0;
+    for(unsigned int t = ticker::TICK_TIME >> 1; k < NUM_BUCKETS - 1 && us < t; t >>= 1)
+      ++k;
+    record(i, k, n);
+  }
+
+  void clear() {
+    CriticalSection cs;
+    for(uint8_t i = 0; i < axes::NUM_ENTRIES; ++i){
+      pulses[i] = 0UL;
+      for(uint8_t k = 0; k < NUM_BUCKETS; ++k)
+        histogram[i][k] = 0;
+    }
+    ticker::maxLatency = 0;
+    ticker::overruns = 0UL;
+  }
+
+  // --- debug -----------------------------------------------------------------
+  void debug() {
+    Serial.println("debug(t):");
+    uint8_t latency;
+    unsigned long over;
+    {
+      CriticalSection cs;
+      latency = ticker::maxLatency;
+      over = ticker::overruns;
+    }
+    Serial.print("latency "); Serial.print(latency / ticker::COUNTS_PER_US, DEC); Serial.println(" us");
+    Serial.print("overrun "); Serial.println(over, DEC);
+  }
+
+  void debugAxis(uint8_t i, char name) {
+    Serial.print(name); Serial.print(", "); Serial.print(pulses[i], DEC); Serial.println(" steps, late by (us):");
+    unsigned int hi = ticker::TICK_TIME;
+    for(uint8_t k = 0; k < NUM_BUCKETS; ++k){
+      unsigned int lo = k < NUM_BUCKETS - 1 ? hi >> 1 : 0;
+      Serial.print("  "); Serial.print(lo, DEC); Serial.print("-"); Serial.print(hi, DEC);
+        Serial.print(" "); Serial.println(histogram[i][k], DEC);
+      hi = lo;
+    }
+  }
+
+}
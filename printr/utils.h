@@ -84,6 +84,27 @@ namespace arduino {
   }
 }
 
+/**
+ * Scoped interrupt lock for data shared with the step timer interrupt.
+ * The previous interrupt state is restored on destruction.
+ * On AVR, cli() also acts as a compiler memory barrier.
+ */
+class CriticalSection {
+public:
+#ifdef __AVR__
+  CriticalSection() : sreg(SREG) {
+    cli();
+  }
+  ~CriticalSection() {
+    SREG = sreg;
+  }
+private:
+  uint8_t sreg;
+#else
+  CriticalSection() {}
+#endif
+};
+
 template <typename T>
 class Array {
 public: